@@ -0,0 +1,393 @@
+#include <precomputation.hpp>
+#include <exporter.hpp>
+#include <bluenoise.hpp>
+#include <sobol_4096spp_256d.h>
+
+#include <benchmark/benchmark.h>
+#include <omp.h>
+
+#include <cstdio>
+#include <cstring>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+
+// Microbenchmarks of the CPU hot paths of the optimizer.
+// The benchmarks that depend on the sample count take it as their first argument, the thread count comes last.
+
+static const std::vector<int64_t> SampleCounts = {1, 4, 16, 64, 256, 4096};
+
+// Default mask of the optimizer, served by the kernels specialized for its size
+static const OptimizerSettings Settings;
+static const int MaskSize = Settings.maskSize;
+static const int PixelCount = MaskSize * MaskSize;
+static const int64_t DistanceMatrixSize = int64_t(distanceMatrixSize(PixelCount));
+static const SequenceTable Table = sequenceTable(bluenoise::Sequence::Table);
+
+static std::vector<int64_t> threadCounts() {
+    std::vector<int64_t> counts;
+
+    int maxThreads = omp_get_max_threads();
+    for(int threads = 1; threads < maxThreads; threads *= 2)
+        counts.push_back(threads);
+    counts.push_back(maxThreads);
+
+    return counts;
+}
+
+static void sppAndThreads(benchmark::internal::Benchmark *benchmark) {
+    benchmark->ArgsProduct({SampleCounts, threadCounts()});
+}
+
+static void threadsOnly(benchmark::internal::Benchmark *benchmark) { benchmark->ArgsProduct({threadCounts()}); }
+
+static std::vector<GLuint> randomScrambles(std::mt19937 &generator) {
+    std::vector<GLuint> scrambles(4 * PixelCount);
+
+    for(int i = 0; i < PixelCount; ++i) {
+        scrambles[4 * i] = generator();
+        scrambles[4 * i + 1] = generator();
+        scrambles[4 * i + 2] = i;
+        scrambles[4 * i + 3] = 0U;
+    }
+
+    return scrambles;
+}
+
+static void BM_IntegrateHeaviside(benchmark::State &state) {
+    const int spp = int(state.range(0));
+
+    std::mt19937 generator(1);
+    std::vector<Heaviside> heavisides = generateHeavisides(HeavisideCount, Philox(1, RandomPurpose::Heavisides));
+    GLuint scramble[2] = {GLuint(generator()), GLuint(generator())};
+
+    int h = 0;
+    for(auto _ : state) {
+        benchmark::DoNotOptimize(integrateHeaviside(scramble, heavisides[h], Table, 0, spp));
+        h = (h + 1) % HeavisideCount;
+    }
+
+    state.SetItemsProcessed(state.iterations() * spp);
+}
+BENCHMARK(BM_IntegrateHeaviside)->ArgsProduct({SampleCounts});
+
+static void BM_SquaredL2Norm(benchmark::State &state) {
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<GLfloat> distribution;
+
+    std::vector<GLfloat> v1(HeavisideCount), v2(HeavisideCount);
+    for(int i = 0; i < HeavisideCount; ++i) {
+        v1[i] = distribution(generator);
+        v2[i] = distribution(generator);
+    }
+
+    for(auto _ : state)
+        benchmark::DoNotOptimize(squaredL2Norm(v1.data(), v2.data(), HeavisideCount));
+
+    state.SetItemsProcessed(state.iterations() * HeavisideCount);
+}
+BENCHMARK(BM_SquaredL2Norm);
+
+static void BM_ComputeEstimates(benchmark::State &state) {
+    const int spp = int(state.range(0));
+    omp_set_num_threads(int(state.range(1)));
+
+    std::mt19937 generator(1);
+    std::vector<GLuint> scrambles = randomScrambles(generator);
+    std::vector<Heaviside> heavisides = generateHeavisides(HeavisideCount, Philox(1, RandomPurpose::Heavisides));
+    std::vector<float> estimates(PixelCount * HeavisideCount);
+
+    for(auto _ : state) {
+        computeEstimates(scrambles.data(), heavisides, Table, 0, spp, PixelCount, estimates);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * PixelCount * HeavisideCount * spp);
+}
+BENCHMARK(BM_ComputeEstimates)->Apply(sppAndThreads)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The estimates with the orientations of the heavisides snapped to 32 bins
+static void BM_ComputeBinnedEstimates(benchmark::State &state) {
+    const int spp = int(state.range(0));
+    omp_set_num_threads(int(state.range(1)));
+
+    std::mt19937 generator(1);
+    std::vector<GLuint> scrambles = randomScrambles(generator);
+    std::vector<Heaviside> heavisides = generateHeavisides(HeavisideCount, Philox(1, RandomPurpose::Heavisides));
+    std::vector<float> estimates(PixelCount * HeavisideCount);
+
+    for(auto _ : state) {
+        computeEstimates(scrambles.data(), heavisides, Table, 0, spp, PixelCount, estimates, 32);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * PixelCount * HeavisideCount * spp);
+}
+BENCHMARK(BM_ComputeBinnedEstimates)->Apply(sppAndThreads)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ComputeDistanceMatrix(benchmark::State &state) {
+    omp_set_num_threads(int(state.range(0)));
+
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<float> distribution;
+
+    std::vector<float> estimates(PixelCount * HeavisideCount);
+    for(float &estimate : estimates)
+        estimate = distribution(generator);
+
+    std::vector<GLfloat> distanceMatrix(DistanceMatrixSize);
+
+    for(auto _ : state) {
+        computeDistanceMatrix(estimates, HeavisideCount, MaskSize, distanceMatrix);
+        benchmark::ClobberMemory();
+    }
+
+    state.SetItemsProcessed(state.iterations() * DistanceMatrixSize);
+}
+BENCHMARK(BM_ComputeDistanceMatrix)->Apply(threadsOnly)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// The whole CPU precomputation of a pair of dimensions, as done by Optimizer::generateDistanceMatrix
+static void BM_GenerateDistanceMatrix(benchmark::State &state) {
+    const int spp = int(state.range(0));
+    omp_set_num_threads(int(state.range(1)));
+
+    std::mt19937 generator(1);
+    std::vector<GLuint> scrambles = randomScrambles(generator);
+    std::vector<float> estimates(PixelCount * HeavisideCount);
+    std::vector<GLfloat> distanceMatrix(DistanceMatrixSize);
+
+    for(auto _ : state) {
+        std::vector<Heaviside> heavisides = generateHeavisides(HeavisideCount, Philox(1, RandomPurpose::Heavisides));
+        computeEstimates(scrambles.data(), heavisides, Table, 0, spp, PixelCount, estimates);
+        computeDistanceMatrix(estimates, HeavisideCount, MaskSize, distanceMatrix);
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(BM_GenerateDistanceMatrix)->Apply(sppAndThreads)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_PreintegrateDisplay(benchmark::State &state) {
+    const int spp = int(state.range(0));
+    omp_set_num_threads(int(state.range(1)));
+
+    std::mt19937 generator(1);
+    std::vector<GLuint> scrambles = randomScrambles(generator);
+
+    for(auto _ : state)
+        benchmark::DoNotOptimize(preintegrateDisplay(scrambles.data(), Table, 0, spp, PixelCount));
+
+    state.SetItemsProcessed(state.iterations() * PixelCount * spp);
+}
+BENCHMARK(BM_PreintegrateDisplay)->Apply(sppAndThreads)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_ExportMaskAsHeader(benchmark::State &state) {
+    std::mt19937 generator(1);
+
+    std::vector<GLuint> scrambles(Settings.dimensions * PixelCount);
+    for(GLuint &scramble : scrambles)
+        scramble = generator();
+
+    const char *filename = "bench_mask.h";
+    for(auto _ : state)
+        exportMaskAsHeader(filename, Settings, scrambles, {});
+
+    std::remove(filename);
+}
+BENCHMARK(BM_ExportMaskAsHeader)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// CPU reimplementation of the energy evaluated by the optimization shader
+static void BM_MaskEnergy(benchmark::State &state) {
+    omp_set_num_threads(int(state.range(0)));
+
+    std::mt19937 generator(1);
+    std::uniform_real_distribution<GLfloat> distribution;
+
+    // Any sequence index will do, they only need to be spread over the whole matrix
+    std::vector<GLuint> texels = randomScrambles(generator);
+    for(int i = 0; i < PixelCount; ++i)
+        texels[4 * i + 2] = generator() % PixelCount;
+
+    std::vector<GLfloat> distanceMatrix(DistanceMatrixSize);
+    for(GLfloat &distance : distanceMatrix)
+        distance = distribution(generator);
+
+    for(auto _ : state)
+        benchmark::DoNotOptimize(maskEnergy(texels.data(), distanceMatrix.data(), MaskSize, MaskSize, 2.1f, 6));
+
+    state.SetItemsProcessed(state.iterations() * PixelCount);
+}
+BENCHMARK(BM_MaskEnergy)->Apply(threadsOnly)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Runtime sampling of a 16x16 tile with the scalar sample() function and the batched one, the dimension count coming
+// first. The ranked variants give each pixel and pair of dimensions its own order of the 4096 samples, so that the rows
+// of the table read by a tile are scattered like in a renderer, the sequence (0 for the table, 1 for the table-free
+// one) coming second.
+static bluenoise::MaskData randomMask(bluenoise::Sequence sequence, bool ranking) {
+    std::mt19937 generator(1);
+
+    bluenoise::MaskData mask;
+    mask.size = MaskSize;
+    mask.dimensions = Settings.dimensions;
+    mask.totalDimensions = Settings.totalDimensions;
+    mask.spp = ranking ? bluenoise::SequenceSamples : Settings.spp;
+    mask.sequence = sequence;
+
+    mask.scramblingKeys.resize(PixelCount * mask.totalDimensions);
+    for(uint32_t &key : mask.scramblingKeys)
+        key = generator();
+
+    if(ranking) {
+        mask.rankingKeys.resize(PixelCount * mask.totalDimensions / 2);
+        for(uint16_t &key : mask.rankingKeys)
+            key = uint16_t(generator() % mask.spp);
+    }
+
+    return mask;
+}
+
+static void BM_SampleScalar(benchmark::State &state) {
+    const int dimensionCount = int(state.range(0));
+
+    bluenoise::MaskData mask = randomMask(bluenoise::Sequence::Table, false);
+    bluenoise::Sampler sampler(mask, sequence);
+
+    int sampleID = 0;
+    for(auto _ : state) {
+        for(int i = 0; i < 16; ++i)
+            for(int j = 0; j < 16; ++j)
+                for(int d = 0; d < dimensionCount; ++d)
+                    benchmark::DoNotOptimize(sampler.sample(i, j, 0, sampleID, d));
+        sampleID = (sampleID + 1) % Settings.spp;
+    }
+
+    state.SetItemsProcessed(state.iterations() * 16 * 16 * dimensionCount);
+}
+BENCHMARK(BM_SampleScalar)->Arg(2)->Arg(8)->Arg(32);
+
+static void sampleTile(benchmark::State &state, bool ranking) {
+    const int dimensionCount = int(state.range(0));
+
+    bluenoise::MaskData mask = randomMask(bluenoise::Sequence(state.range(1)), ranking);
+    bluenoise::Sampler sampler(mask, sequence);
+    std::vector<float> samples(16 * 16 * dimensionCount);
+
+    // The tiles sweep the mask like the tiles of a frame
+    int sampleID = 0;
+    int tile = 0;
+    for(auto _ : state) {
+        sampler.sampleTile(16 * (tile / (MaskSize / 16)), 16 * (tile % (MaskSize / 16)), 16, 16, 0, sampleID, 0,
+                           dimensionCount, samples.data());
+        benchmark::ClobberMemory();
+
+        tile = (tile + 1) % (PixelCount / 256);
+        if(tile == 0)
+            sampleID = (sampleID + 1) % Settings.spp;
+    }
+
+    state.SetItemsProcessed(state.iterations() * 16 * 16 * dimensionCount);
+}
+
+static void BM_SampleTile(benchmark::State &state) { sampleTile(state, false); }
+BENCHMARK(BM_SampleTile)->ArgsProduct({{2, 8, 32}, {0, 1}});
+
+static void BM_SampleTileRanked(benchmark::State &state) { sampleTile(state, true); }
+BENCHMARK(BM_SampleTileRanked)->ArgsProduct({{2, 8, 32}, {0, 1}});
+
+// Hardware cache misses of the calling thread, only counted when the kernel and the machine expose them
+class CacheMissCounters {
+public:
+    CacheMissCounters() {
+#ifdef __linux__
+        m_l1 = open(PERF_COUNT_HW_CACHE_L1D);
+        m_lastLevel = open(PERF_COUNT_HW_CACHE_LL);
+#endif
+    }
+
+    ~CacheMissCounters() {
+#ifdef __linux__
+        if(m_l1 >= 0)
+            close(m_l1);
+        if(m_lastLevel >= 0)
+            close(m_lastLevel);
+#endif
+    }
+
+    /// \brief Add the misses per unit of work since the creation of the counters to the benchmark counters.
+    void report(benchmark::State &state, double unitsPerIteration) const {
+        const benchmark::Counter::Flags flags = benchmark::Counter::kAvgIterations;
+
+        if(m_l1 >= 0)
+            state.counters["L1D_misses"] = benchmark::Counter(read(m_l1) / unitsPerIteration, flags);
+        if(m_lastLevel >= 0)
+            state.counters["LLC_misses"] = benchmark::Counter(read(m_lastLevel) / unitsPerIteration, flags);
+    }
+
+private:
+#ifdef __linux__
+    static int open(uint64_t cache) {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = PERF_TYPE_HW_CACHE;
+        attributes.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+
+        return int(syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0));
+    }
+
+    static double read(int counter) {
+        uint64_t value = 0;
+
+        return ::read(counter, &value, sizeof(value)) == sizeof(value) ? double(value) : 0.0;
+    }
+#else
+    static double read(int) { return 0.0; }
+#endif
+
+    int m_l1 = -1;
+
+    int m_lastLevel = -1;
+};
+
+// Runtime sampling of the whole default mask, walked in 16x16 tiles like a renderer, with the pixels stored row by row
+// (the 256 keys of each pixel) or along the Morton curve (only the used keys). The layout (0 for the rows, 1 for the
+// Morton curve) comes first and the dimension count second, the cache misses being counted per tile.
+static void BM_SampleLayout(benchmark::State &state) {
+    const bluenoise::Layout layout = bluenoise::Layout(state.range(0));
+    const int dimensionCount = int(state.range(1));
+    const int TileSize = 16;
+    const int tileCount = PixelCount / (TileSize * TileSize);
+
+    const int stride = layout == bluenoise::Layout::Morton ? Settings.totalDimensions : bluenoise::ScramblingKeyExtent;
+
+    std::mt19937 generator(1);
+    std::vector<uint32_t> scramblingKeys(size_t(PixelCount) * stride);
+    for(uint32_t &key : scramblingKeys)
+        key = generator();
+
+    bluenoise::Sampler sampler(scramblingKeys.data(), nullptr, MaskSize, 1, Settings.totalDimensions, sequence, layout);
+    std::vector<float> samples(TileSize * TileSize * dimensionCount);
+
+    CacheMissCounters counters;
+
+    int sampleID = 0;
+    for(auto _ : state) {
+        for(int tile = 0; tile < tileCount; ++tile) {
+            sampler.sampleTile(TileSize * (tile / (MaskSize / TileSize)), TileSize * (tile % (MaskSize / TileSize)),
+                               TileSize, TileSize, 0, sampleID, 0, dimensionCount, samples.data());
+            benchmark::ClobberMemory();
+        }
+
+        sampleID = (sampleID + 1) % Settings.spp;
+    }
+
+    counters.report(state, tileCount);
+    state.SetItemsProcessed(state.iterations() * PixelCount * dimensionCount);
+}
+BENCHMARK(BM_SampleLayout)->ArgsProduct({{0, 1}, {8, 64}})->Unit(benchmark::kMicrosecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <optimizer.hpp>
+
+#include <string>
+
+
+// Tuning of the dispatch parameters of the optimizer for the device: short bursts of dispatches are timed with every
+// work group size, and the fastest one of each swap attempts count is cached in a text file, one entry per device
+// string, mask size and swap attempts count. The work group size does not change the masks. The swap attempts per
+// dispatch do, so they are only tuned on request, by throughput alone.
+
+/// \brief Query the string identifying the device of the current context, along with its driver.
+/// \return The renderer and the version strings of the context.
+std::string deviceString();
+
+/// \brief Find the fastest dispatch parameters of the device and use them, timing the ones that are not cached yet.
+/// \param optimizer The optimizer, set up for the first mask to optimize.
+/// \param settings The parameters of the optimization, its dispatch parameters are replaced with the tuned ones.
+/// \param cacheFile The file the tuned parameters are cached in.
+/// \param tuneSwapAttempts True to also pick the swap attempts per dispatch with the lowest time per attempt, which
+/// changes the masks. Otherwise only the work group size is tuned.
+void autotune(Optimizer &optimizer, OptimizerSettings &settings, const std::string &cacheFile, bool tuneSwapAttempts);
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <optimizer.hpp>
+
+#include <string>
+
+
+// Distributed optimization through a shared directory: the coordinator publishes the jobs, the workers claim their
+// pairs of dimensions one at a time and write the optimized keys of each pair in a plane file, the coordinator then
+// merges the planes of each job into a mask. The claims rely on the atomic exclusive creation of files, which also
+// holds on network file systems.
+
+/// \brief A pair of dimensions of a job, optimized independently of the other pairs.
+struct Task {
+    int job;
+
+    int pair;
+};
+
+/// \brief Write the parameters of a job in the shared directory.
+/// \param directory The shared directory.
+/// \param job The index of the job.
+/// \param settings The parameters of the optimization of the job.
+/// \param threshold The number of accepted permutations per 100 dispatches below which a level is converged.
+/// \return False if the file could not be written.
+bool publishJob(const std::string &directory, int job, const OptimizerSettings &settings, int threshold);
+
+/// \brief Make the published jobs available to the workers.
+/// \note Must be called once all the jobs are published.
+/// \param directory The shared directory.
+/// \param jobCount The number of published jobs.
+/// \return False if the file could not be written.
+bool publishJobCount(const std::string &directory, int jobCount);
+
+/// \brief Query the number of jobs available to the workers.
+/// \param directory The shared directory.
+/// \return The number of jobs, 0 if they are not published yet.
+int publishedJobCount(const std::string &directory);
+
+/// \brief Read the parameters of a published job.
+/// \param directory The shared directory.
+/// \param job The index of the job.
+/// \param settings The parameters of the optimization of the job.
+/// \param threshold The number of accepted permutations per 100 dispatches below which a level is converged.
+/// \return False if the file could not be read.
+bool readPublishedJob(const std::string &directory, int job, OptimizerSettings &settings, int &threshold);
+
+/// \brief Claim the first pair of dimensions that no worker claimed yet.
+/// \note A claim is never released: remove its file to optimize the pair again, e.g. after a worker crashed.
+/// \param directory The shared directory.
+/// \param jobCount The number of published jobs.
+/// \param pairCount The number of pairs of dimensions of each job.
+/// \param task The claimed pair of dimensions.
+/// \return False if every pair of dimensions has already been claimed.
+bool claimTask(const std::string &directory, int jobCount, int pairCount, Task &task);
+
+/// \brief Build the name of the file the keys of a pair of dimensions are written in.
+/// \param directory The shared directory.
+/// \param task The pair of dimensions.
+/// \return The name of the plane file.
+std::string planeFile(const std::string &directory, const Task &task);
+
+/// \brief Write the keys of a pair of dimensions.
+/// \note The plane is written in a temporary file renamed once complete, so that it is never read partially.
+/// \param filename The name of the plane file.
+/// \param settings The parameters the mask was optimized with.
+/// \param dimension The first dimension of the pair.
+/// \param scrambles The scrambling values of every dimension, settings.dimensions values per pixel of each frame.
+/// \param rankings The ranking keys of every pair, one per pair per pixel of each frame, or nothing.
+/// \return False if the file could not be written.
+bool writePlane(const std::string &filename, const OptimizerSettings &settings, int dimension,
+                const std::vector<GLuint> &scrambles, const std::vector<GLuint> &rankings);
+
+/// \brief Read the keys of a pair of dimensions into the keys of the whole mask.
+/// \param filename The name of the plane file.
+/// \param settings The parameters the mask was optimized with.
+/// \param scrambles The scrambling values of every dimension, settings.dimensions values per pixel of each frame.
+/// \param rankings The ranking keys of every pair, allocated by the first plane that has some.
+/// \return False if the file could not be read or does not match the settings.
+bool readPlane(const std::string &filename, const OptimizerSettings &settings, std::vector<GLuint> &scrambles,
+               std::vector<GLuint> &rankings);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <precomputation.hpp>
+
+#include <complex>
+
+
+// Quality of an exported mask: the error images of a bank of heavisides integrated with the mask are transformed
+// with a 2D FFT, and their power spectra are averaged over the integrands, the frames and the pairs of dimensions.
+// A blue noise mask pushes the power of the error towards the high frequencies.
+
+/// \brief A mask loaded from an exported header.
+struct EvaluatedMask {
+    OptimizerSettings settings;
+
+    std::vector<GLuint> scrambles; // settings.totalDimensions values per pixel of each frame
+
+    std::vector<GLuint> rankings; // settings.totalDimensions / 2 values per pixel of each frame, or nothing
+};
+
+/// \brief Power spectrum of the error images, averaged over the annuli around the null frequency.
+struct RadialSpectrum {
+    std::vector<double> power; // Mean power of each annulus, indexed by the integer radius up to the Nyquist frequency
+
+    std::vector<double> anisotropy; // Variance of the power of each annulus over its squared mean, in dB
+};
+
+/// \brief Compute the error image of an integrand, centered on its mean so that its null frequency vanishes.
+/// \param mask The mask to integrate with.
+/// \param heaviside The integrand.
+/// \param dimension The first dimension of the pair of dimensions to integrate with.
+/// \param frame The frame of the mask.
+/// \param spp The number of samples of each pixel, the first ones of the ranked order when the mask has ranking keys.
+/// \param error The error of each pixel.
+void errorImage(const EvaluatedMask &mask, const Heaviside &heaviside, int dimension, int frame, int spp,
+                std::vector<double> &error);
+
+/// \brief Compute the 2D discrete Fourier transform of a square image in place, the rows and the columns being
+/// transformed in parallel.
+/// \param data The image, stored row by row.
+/// \param size The side of the image, a power of two.
+void fft2D(std::vector<std::complex<double>> &data, int size);
+
+/// \brief Add the power spectrum of an image to an accumulated one.
+/// \param image The image, stored row by row.
+/// \param size The side of the image, a power of two.
+/// \param power The accumulated power of each frequency, stored row by row with the null frequency first.
+void accumulatePowerSpectrum(const std::vector<double> &image, int size, std::vector<double> &power);
+
+/// \brief Average a power spectrum over the annuli around the null frequency.
+/// \param power The power of each frequency, stored row by row with the null frequency first.
+/// \param size The side of the spectrum.
+/// \return The mean power and the anisotropy of each annulus.
+RadialSpectrum radialAverage(const std::vector<double> &power, int size);
+
+/// \brief Measure the share of the power of a spectrum below a cutoff frequency, the null frequency excluded.
+/// \param power The power of each frequency, stored row by row with the null frequency first.
+/// \param size The side of the spectrum.
+/// \param cutoff The cutoff frequency, relative to the Nyquist frequency.
+/// \return The share of the power below the cutoff, in [0, 1].
+double lowFrequencyEnergy(const std::vector<double> &power, int size, double cutoff);
+
+/// \brief Measure the share of the frequencies below a cutoff, the null frequency excluded, i.e. the share of the power
+/// of a white noise.
+/// \param size The side of the spectrum.
+/// \param cutoff The cutoff frequency, relative to the Nyquist frequency.
+/// \return The share of the frequencies below the cutoff, in [0, 1].
+double lowFrequencyShare(int size, double cutoff);
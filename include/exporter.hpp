@@ -0,0 +1,68 @@
+#pragma once
+
+#include <optimizer.hpp>
+
+
+/// \brief Export a mask as a header, along with its sampling function.
+/// \note The sampling function takes a frame index when the mask has several frames.
+/// \param filename The name of the file to export the mask in.
+/// \param settings The parameters the mask was optimized with.
+/// \param scrambles The optimized scrambling values, settings.dimensions values per pixel of each frame.
+/// \param rankings The optimized ranking keys, one per pair of dimensions per pixel of each frame, or nothing to
+/// export the scrambles only.
+void exportMaskAsHeader(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                        const std::vector<GLuint> &rankings);
+
+/// \brief Export a mask as a header, and as the textures selected by settings.textures and the swap log of
+/// settings.swapLog, the keys of the dimensions that were not optimized being the same in all the files.
+/// \param filename The name of the header to export the mask in, the textures are named after it.
+/// \param settings The parameters the mask was optimized with.
+/// \param scrambles The optimized scrambling values, settings.dimensions values per pixel of each frame.
+/// \param rankings The optimized ranking keys, one per pair of dimensions per pixel of each frame, or nothing.
+void exportMask(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                const std::vector<GLuint> &rankings);
+
+/// \brief Export the keys of a mask as the textures selected by settings.textures, the dimensions of the texture
+/// arrays being written in parallel:
+///  - KTX2: a MaskSize x MaskSize R32UI texture array of settings.totalDimensions layers per frame, and a R16UI one of
+///    settings.totalDimensions / 2 layers per frame for the ranking keys.
+///  - PNG: a 16 bit gray and alpha image of the top 16 bits of the keys of each pair of dimensions, the frames being
+///    stacked vertically, to be sampled as a RG16 texture.
+///  - Raw: the layers of the KTX2 texture arrays, in the byte order of the host.
+/// \param filename The name of the header of the mask, the textures are named after it.
+/// \param settings The parameters the mask was optimized with.
+/// \param keys The scrambling keys, settings.totalDimensions values per pixel of each frame, e.g. from loadMaskHeader.
+/// \param rankingKeys The ranking keys, settings.totalDimensions / 2 values per pixel of each frame, or nothing.
+/// \return False if a texture could not be written.
+bool exportMaskAsTextures(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &keys,
+                          const std::vector<GLuint> &rankingKeys);
+
+/// \brief Load a mask exported by exportMaskAsHeader.
+/// \param filename The name of the header the mask was exported in.
+/// \param settings The parameters the mask was optimized with, as far as they are recorded in the header.
+/// \param scrambles The scrambling values, settings.totalDimensions values per pixel of each frame.
+/// \param rankings The ranking keys, settings.totalDimensions / 2 values per pixel of each frame, or nothing.
+/// \return False if the file could not be read or was not exported by exportMaskAsHeader.
+bool loadMaskHeader(const char *filename, OptimizerSettings &settings, std::vector<GLuint> &scrambles,
+                    std::vector<GLuint> &rankings);
+
+/// \brief Export a mask as a swap log, from which loadSwapLog rebuilds it. The accepted swaps of a pair of dimensions
+/// compose into a permutation of its seeded sequences in each frame, so the log only stores that permutation, each
+/// sequence as its rank among the ones not placed yet (in as many bits as their count needs), and the ranking keys in
+/// as many bits as the sample count needs. The keys of the dimensions that were not optimized come from the seed.
+/// \param filename The name of the file to export the log in.
+/// \param settings The parameters the mask was optimized with, the ones the export depends on are stored in the log.
+/// \param scrambles The optimized scrambling values, settings.dimensions values per pixel of each frame.
+/// \param rankings The optimized ranking keys, one per pair of dimensions per pixel of each frame, or nothing.
+/// \return False if the log could not be written, or if the scrambles are not the sequences of settings.seed.
+bool exportSwapLog(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                   const std::vector<GLuint> &rankings);
+
+/// \brief Replay a swap log exported by exportSwapLog.
+/// \param filename The name of the log.
+/// \param settings The parameters the mask was optimized with, as far as its export depends on them.
+/// \param scrambles The optimized scrambling values, settings.dimensions values per pixel of each frame.
+/// \param rankings The optimized ranking keys, one per pair of dimensions per pixel of each frame, or nothing.
+/// \return False if the file could not be read or is not a swap log.
+bool loadSwapLog(const char *filename, OptimizerSettings &settings, std::vector<GLuint> &scrambles,
+                 std::vector<GLuint> &rankings);
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <utils.hpp>
+
+
+// OpenGL context without any window, for the servers without a display (e.g. Mesa llvmpipe in CI). It is created
+// through EGL, on the surfaceless platform of Mesa when it is available and on a pbuffer of the default display
+// otherwise. The optimizer must be built with EGL (HEADLESS_EGL) for it to be available.
+
+/// \brief Create an OpenGL 4.3 core context without any window and make it current.
+/// \return False if EGL is not available or could not create the context.
+bool createHeadlessContext();
+
+/// \brief Load an OpenGL function of the headless context, to be passed to gladLoadGLLoader.
+/// \param name The name of the function.
+/// \return The address of the function, nullptr if it is not available.
+void *headlessProcAddress(const char *name);
+
+/// \brief Destroy the headless context.
+void destroyHeadlessContext();
@@ -1,23 +1,117 @@
 #pragma once
 
 #include <utils.hpp>
+#include <bluenoise.hpp>
+#include <random.hpp>
 
 #include <random>
 #include <utility>
 
 
 // Constants definition
-constexpr int D = 2 * 8; // Must be a multiple of 2
-constexpr int TotalD = 64; // The total number of dimensions exported: must be a power of two
+constexpr int HeavisideCount = 1024;
+constexpr int WorkGroupSize = 32;
+constexpr int SwapAttemptsDivisor = 2; // Swap attempts count = Pixel count / (2 * swapAttemptsDivisor)
+
+/// \brief How the pairs of pixels tested by a dispatch are drawn.
+enum class Proposal {
+    Global, // Pairs from a random permutation of the whole mask
+    Local,  // Pairs inside randomly placed tiles, drawn on the GPU at each dispatch
+    Hybrid  // Global proposals, then local ones once the global ones stall
+};
+
+struct Heaviside;
+
+/// \brief How the heavisides estimating the distance between two sequences are drawn.
+enum class HeavisideBank {
+    Random,     // Uniform random orientations and points
+    Stratified, // Jittered strata of the orientation, Latin hypercube points
+    Sobol       // Owen scrambled 3D Sobol points over the orientation and the point
+};
+
+/// \brief Textures the keys of a mask are exported as along with its header, combined as flags.
+enum TextureFormat {
+    TextureKTX2 = 1, // R32UI texture array of the scrambling keys, one layer per dimension of each frame
+    TexturePNG = 2,  // 16 bit gray and alpha image of the top bits of the keys of each pair of dimensions
+    TextureRaw = 4   // The layers of the KTX2 texture array, without any header
+};
+
+/// \brief Runtime parameters of the optimization.
+struct OptimizerSettings {
+    int maskSize = 128; // Must be a power of two, at least 16
+
+    int dimensions = 16; // Optimized dimensions: must be a multiple of 2
+
+    int totalDimensions = 64; // The total number of dimensions exported: must be a power of two, at most 256
+
+    int spp = 16;
+
+    Proposal proposal = Proposal::Global;
+
+    int tileSize = 8; // Side of the tiles used by local proposals: must be a power of two
+
+    HeavisideBank heavisideBank = HeavisideBank::Random;
+
+    int heavisideCount = HeavisideCount; // Heavisides of the distance matrix, the precomputation is linear in it
+
+    int orientationBins = 0; // Orientation bins of the heavisides of the estimates, 0 for exact orientations
+
+    bool gpuPrecomputation = false; // Compute the estimates and the distance matrix with compute shaders
+
+    bool validatePrecomputation = false; // Compare the GPU precomputation to the CPU one, reading the matrix back
 
-constexpr int MaskSize = 128; // Must be a power of two
-constexpr int PixelCount = MaskSize * MaskSize;
-constexpr int DistanceMatrixSize = PixelCount * (PixelCount + 1) / 2;
+    int levels = 1; // Resolution levels of the coarse-to-fine optimization, 1 optimizes the full mask directly
+
+    bool ranking = false; // Optimize the order of the samples so that every power of two prefix is a blue noise
+
+    int frames = 1; // Frames of the spatiotemporal mask, the volume wraps around in time as in space
+
+    bluenoise::Sequence sequence = bluenoise::Sequence::Table; // The sequence the scrambling keys are applied to
+
+    bluenoise::Layout layout = bluenoise::Layout::Rows; // The order the pixels of the exported tables are stored in
+
+    bool display = true; // Pre-integrate the gaussian of the preview, headless runs skip it
+
+    bool staging = true; // Stage the sequence indices around the candidates of a work group in shared memory
+
+    bool neighborCache = true; // Cache the distances of each pixel to its neighbors, patched after the swaps
+
+    int workGroupSize = WorkGroupSize; // Invocations per work group of the optimizer, a power of two
+
+    int swapAttemptsDivisor = SwapAttemptsDivisor; // One pixel out of it is tested per dispatch, a power of two
+
+    int textures = 0; // TextureFormat flags of the textures exported along with the header
+
+    bool swapLog = false; // Also export the mask as a swap log, a few hundred KB the Replayer rebuilds it from
+
+    int pair = -1; // Only optimize this pair of dimensions, -1 to optimize them all
+
+    uint32_t seed = 0; // The random streams of a pair of dimensions only depend on it and on the pair
+};
 
 class Optimizer {
 public:
     /// \brief Default constructor.
-    Optimizer(int spp);
+    /// \param settings The parameters of the optimization.
+    Optimizer(const OptimizerSettings &settings);
+
+    /// \brief Restart the optimization of a new mask from the first pair of dimensions.
+    /// \note The shaders, the GL buffers and the host memory are reused, so the mask size must not change. The
+    /// optimizer shader is only rebuilt if the work group size changes.
+    /// \param settings The parameters of the optimization of the new mask.
+    void reset(const OptimizerSettings &settings);
+
+    /// \brief Time a short burst of dispatches with other dispatch parameters, the mask being restored after it.
+    /// \note The burst tests the full resolution with the current proposal strategy.
+    /// \param workGroupSize The invocations per work group of the burst.
+    /// \param swapAttemptsDivisor One pixel out of swapAttemptsDivisor is tested per dispatch of the burst.
+    /// \return The GPU time per attempted swap, in nanoseconds.
+    double timeDispatches(int workGroupSize, int swapAttemptsDivisor);
+
+    /// \brief Use other dispatch parameters from the next dispatch on, e.g. the ones tuned for the device.
+    /// \param workGroupSize The invocations per work group, the shader is rebuilt when it changes.
+    /// \param swapAttemptsDivisor One pixel out of swapAttemptsDivisor is tested per dispatch.
+    void setDispatchParameters(int workGroupSize, int swapAttemptsDivisor);
 
     /// \brief Free the GL ressources before the destruction of the object.
     /// \note This is required because otherwise the context will be destroyed before the ressources are freed.
@@ -26,10 +120,34 @@ public:
     /// \brief Dispatch the compute shader.
     void run() const;
 
-    /// \brief Starts the optimization of the next pair of dimensions.
+    /// \brief Starts the optimization of the next resolution level, or of the next pair of dimensions.
     /// \return False if all the dimensions have already been optimized.
     bool nextDimensions();
 
+    /// \brief Accessor for the pair of dimensions being optimized.
+    /// \return The index of the first dimension of the pair.
+    int dimension() const;
+
+    /// \brief Query the amount of GPU memory allocated by the optimizer.
+    /// \return The size of all the buffers and textures, in bytes.
+    GLint64 gpuMemoryUsage() const;
+
+    /// \brief Accessor for the current resolution level.
+    /// \return The current level, 0 being the full resolution mask.
+    int level() const;
+
+    /// \brief Evaluate the energy of the current pair of dimensions at the current level.
+    /// \return The sum of the energies of all the pixels.
+    double energy() const;
+
+    /// \brief Select the swap proposal strategy used by the next dispatches.
+    /// \param local True to draw the candidate pairs inside tiles, false to draw them from the whole mask.
+    void useLocalProposals(bool local);
+
+    /// \brief Accessor for the current swap proposal strategy.
+    /// \return True if the candidate pairs are drawn inside tiles.
+    bool usesLocalProposals() const;
+
     /// \brief Query the number of permutations that was accepted in all the compute shader dispatches.
     /// \return The number of permutations that was accepted in all the dispatches.
     uint32_t acceptedSwapCount() const;
@@ -38,58 +156,128 @@ public:
     /// \return The display texture OpenGL ID.
     GLuint displayTexture() const;
 
-    /// \brief Export the latest mask as a header.
-    /// \param filename The name of the file to export the mask in.
-    void exportMaskAsHeader(const char *filename) const;
+    /// \brief Export the latest mask as a header, and as the textures selected by the settings.
+    /// \param filename The name of the header to export the mask in, the textures are named after it.
+    void exportMask(const char *filename) const;
+
+    /// \brief Export the keys of the pair of dimensions optimized alone, to be merged with the other pairs later.
+    /// \param filename The name of the plane file.
+    /// \return False if the file could not be written.
+    bool exportPlane(const std::string &filename) const;
 
 private:
     int m_dimension = 0;
 
+    int m_endDimension; // The dimension after the last pair to optimize
+
+    OptimizerSettings m_settings;
+
+    const int m_maskSize;
+
+    const int m_pixelCount;
+
     GLuint m_program;
 
-    GLuint m_distanceMatrixSSBO;
+    int m_workGroupSize; // The work group size m_program was built with
+
+    GLuint m_estimatesProgram = 0; // Programs of the GPU precomputation, only built when it is enabled
 
-    GLuint m_scramblesIn;
+    GLuint m_distancesProgram = 0;
 
-    GLuint m_scramblesOut;
+    GLuint m_distanceMatrixSSBO = 0;
 
-    GLuint m_displayIn;
+    GLuint m_estimatesSSBO = 0;
 
-    GLuint m_displayOut;
+    GLuint m_scramblesIn = 0;
 
-    mutable std::mt19937 m_generator;
+    GLuint m_scramblesOut = 0;
 
-    GLuint m_permutationsSSBO;
+    GLuint m_displayIn = 0;
 
-    GLuint m_atomicCounter;
+    GLuint m_displayOut = 0;
 
+    mutable Philox m_generator; // Sequential draws of the current pair of dimensions
+
+    GLuint m_permutationsSSBO = 0;
+
+    GLuint m_atomicCounter = 0;
+
+    GLuint m_energySSBO = 0;
+
+    GLuint m_neighborCacheSSBO = 0;
+
+    bool m_neighborCache; // Disabled by the settings, or when the cache does not fit in a shader storage block
+
+    bool m_gpuPrecomputation; // Disabled by the settings, or when the estimates do not fit in a shader storage block
+
+    // Optimized scrambles, m_settings.dimensions values per pixel of each frame
     std::vector<GLuint> m_scrambles;
 
+    // Ranking keys of each pair of dimensions, one per pair per pixel of each frame, empty if the ranking is disabled
+    std::vector<GLuint> m_rankings;
+
+    // Scrambles and display values of the current pair of dimensions, indexed by sequence
+    // Every frame is a permutation of the same m_pixelCount sequences, so the distance matrix does not grow with time
+    std::vector<GLuint> m_sequences;
+
+    std::vector<GLfloat> m_sequenceDisplay;
+
+    // Host memory of the precomputations, kept from one pair of dimensions (and one mask) to the next, empty when
+    // they run on the GPU
+    std::vector<float> m_estimates;
+
+    std::vector<GLfloat> m_distanceMatrix;
+
     int m_spp;
 
+    int m_tileSize;
 
-    //// Refactoring functions ////
+    bool m_localProposals;
+
+    bool m_ranking;
+
+    int m_frameCount;
+
+    int m_levelCount;
 
-    struct Heaviside {
-        // Orientation vector
-        float nx;
-        float ny;
+    int m_level;
 
-        // 2D point
-        float px;
-        float py;
-    };
+
+    //// Refactoring functions ////
 
     /// \brief Generate the permutations that will be tested by the compute shader and store them in an SSBO.
     void generatePermutationsSSBO();
 
-    /// \brief Generate the atomic coutner used to track the number of swaps in a single dispatch;
+    /// \brief Generate the atomic counter used to track the number of swaps, or reset it if it already exists.
     void generateAtomicCounter();
 
+    /// \brief Generate the buffer the energy of each pixel of each frame is written in when evaluating the mask, or
+    /// resize it if it already exists.
+    void generateEnergySSBO();
+
+    /// \brief Generate the buffer of the neighbor distance cache, or resize it if it already exists. The cache is
+    /// disabled if it does not fit in a shader storage block.
+    void generateNeighborCacheSSBO();
+
+    /// \brief Accessor for the side of the mask at the current resolution level.
+    /// \return The side of the mask at the current level.
+    int levelSize() const;
+
+    /// \brief Set the shader parameters that depend on the resolution level and the proposal strategy.
+    void setupLevel();
+
+    /// \brief Move to the next resolution level: the sequences of the current level are placed on the even pixels
+    /// and the remaining pixels receive new sequences, in a different order in each frame.
+    void upsampleLevel();
+
+    /// \brief Upload the scrambles of the pixels and their display values to the images used by the shader.
+    /// \param texels The scrambles of each pixel of the full resolution frames, stacked vertically.
+    void uploadTexels(const std::vector<GLuint> &texels);
+
     /// \brief Build the estimates matrix via calls to computeEstimatesMatrix and send it to the GPU.
     void setupTextures();
 
-    /// \brief Generate an OpenGL RGBA32F 3D texture.
+    /// \brief Generate an OpenGL 2D texture holding all the frames, stacked vertically.
     /// \param internal_format The OpenGL internal format of the texture.
     /// \param format The OpenGL format of the texture.
     /// \param data_type The type of the data stored in the texture.
@@ -104,13 +292,11 @@ private:
     /// \param scrambles The scrambling values for all the dimensions.
     void generateDistanceMatrix(GLuint *scrambles);
 
-    /// \brief Preintegrate a given function (in that case, a 2D gaussian) that will be displayed.
-    /// \param scrambling The scrambling values for all the dimensions.
-    /// \return A vector containing the result.
-    std::vector<GLfloat> preintegrateDisplay(GLuint *scrambling) const;
+    /// \brief Compute the estimates and the distance matrix with the compute shaders, straight into the SSBO.
+    /// \param scrambles The scrambling values of each pixel, 4 values per pixel.
+    /// \param heavisides The heavisides to integrate.
+    void computeDistanceMatrixGPU(const GLuint *scrambles, const std::vector<Heaviside> &heavisides);
 
-    /// \brief Integrate a 2D heaviside.
-    /// \param scramble The scramble values to use for each dimensions.
-    /// \param heaviside The 4 parameters that define an heaviside (i.e. an orientation vector and a 2D point).
-    float integrateHeaviside(GLuint scramble[2], const Heaviside &heaviside) const;
+    /// \brief Compare the distance matrix computed on the GPU to the one computed on the CPU, and log the differences.
+    void validateDistanceMatrix();
 };
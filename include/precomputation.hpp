@@ -0,0 +1,128 @@
+#pragma once
+
+#include <optimizer.hpp>
+
+
+// CPU side of the optimization: everything that can run without an OpenGL context
+
+struct Heaviside {
+    // Orientation vector
+    float nx;
+    float ny;
+
+    // 2D point
+    float px;
+    float py;
+};
+
+/// \brief The samples of a sequence, SequenceDimensions values per sample.
+using SequenceTable = const GLuint (*)[bluenoise::SequenceDimensions];
+
+/// \brief Access the samples of a sequence as a table.
+/// \note The table-free sequence is generated the first time it is needed, the optimization reading each sample many
+/// times.
+/// \param sequence The sequence.
+/// \return The table of the first SequenceSamples samples of the sequence.
+SequenceTable sequenceTable(bluenoise::Sequence sequence);
+
+/// \brief Map the (i, j) coordinates of the distance matrix to a 1D index in the vectorized upper triangular matrix.
+/// \param i The index of the first sequence.
+/// \param j The index of the second sequence, j >= i.
+/// \param pixelCount The number of sequences.
+/// \return The index of the distance between the two sequences.
+inline size_t distanceIndex(size_t i, size_t j, size_t pixelCount) { return j + i * pixelCount - i * (i + 1) / 2; }
+
+/// \brief Compute the size of the vectorized upper triangular distance matrix.
+/// \param pixelCount The number of sequences.
+/// \return The number of distances stored.
+inline size_t distanceMatrixSize(size_t pixelCount) { return pixelCount * (pixelCount + 1) / 2; }
+
+/// \brief Generate heavisides with a random orientation and a random point in the unit square.
+/// \note The stratified and Sobol banks cover the orientations and the points more evenly than the random one, so the
+/// distances between the sequences converge with fewer heavisides.
+/// \param count The number of heavisides to generate, a power of two for the Sobol bank to be a net.
+/// \param stream The random stream to use, the heaviside i being drawn from its block i.
+/// \param bank How the orientations and the points are drawn.
+/// \return The heavisides.
+std::vector<Heaviside> generateHeavisides(int count, const Philox &stream, HeavisideBank bank = HeavisideBank::Random);
+
+/// \brief Integrate a 2D heaviside.
+/// \param scramble The scramble values to use for each dimensions.
+/// \param heaviside The 4 parameters that define an heaviside (i.e. an orientation vector and a 2D point).
+/// \param table The samples of the sequence to integrate with.
+/// \param dimension The first dimension of the pair of dimensions of the sequence to integrate with.
+/// \param spp The number of samples of the sequence to integrate with.
+/// \param firstSample The index of the first sample of the sequence to integrate with.
+/// \return The estimate of the integral.
+float integrateHeaviside(const GLuint scramble[2], const Heaviside &heaviside, SequenceTable table, int dimension,
+                         int spp, int firstSample = 0);
+
+/// \brief Compute the squared L2 distance between two vectors.
+/// \param v1 The first vector.
+/// \param v2 The second vector.
+/// \param dimension The size of the vectors.
+/// \return The squared distance.
+GLfloat squaredL2Norm(const GLfloat *v1, const GLfloat *v2, int dimension);
+
+/// \brief Integrate every heaviside with the sequence of every pixel.
+/// \param scrambles The scramble values of each pixel, 4 values per pixel.
+/// \param heavisides The heavisides to integrate.
+/// \param table The samples of the sequence to integrate with.
+/// \param dimension The first dimension of the pair of dimensions to integrate with.
+/// \param spp The number of samples of the sequences.
+/// \param pixelCount The number of pixels.
+/// \param estimates The estimates of each pixel, stored contiguously for each pixel.
+/// \param orientationBins The orientations of the heavisides are snapped to this many directions, so that each sample
+/// of a pixel is only compared to the heavisides of each bin with a binary search. 0 integrates the exact heavisides
+/// sample by sample.
+void computeEstimates(const GLuint *scrambles, const std::vector<Heaviside> &heavisides, SequenceTable table,
+                      int dimension, int spp, int pixelCount, std::vector<float> &estimates, int orientationBins = 0);
+
+/// \brief Compute the distance between the estimates of every pair of sequences.
+/// \note Dispatched to a kernel specialized for the mask size when there is one.
+/// \param estimates The estimates of each sequence.
+/// \param heavisideCount The number of estimates of each sequence.
+/// \param maskSize The side of the mask, the number of sequences being its square.
+/// \param distanceMatrix The upper triangular distance matrix, indexed with distanceIndex.
+void computeDistanceMatrix(const std::vector<float> &estimates, int heavisideCount, int maskSize,
+                           std::vector<GLfloat> &distanceMatrix);
+
+/// \brief Preintegrate a given function (in that case, a 2D gaussian) that will be displayed.
+/// \param scrambling The scrambling values of each pixel, 4 values per pixel.
+/// \param table The samples of the sequence to integrate with.
+/// \param dimension The first dimension of the pair of dimensions to integrate with.
+/// \param spp The number of samples of the sequences.
+/// \param pixelCount The number of pixels.
+/// \return A vector containing the result.
+std::vector<GLfloat> preintegrateDisplay(const GLuint *scrambling, SequenceTable table, int dimension, int spp,
+                                         int pixelCount);
+
+/// \brief Evaluate the energy of a mask the same way the optimization shader does.
+/// \note Dispatched to a kernel specialized for the mask size and the radius when there is one.
+/// \param texels The scrambles of the full resolution image, the sequence index being the third of the 4 values.
+/// \param distanceMatrix The upper triangular distance matrix, indexed with distanceIndex.
+/// \param maskSize The side of the full resolution image.
+/// \param size The side of the mask, only the top left corner of the image is used if it is below maskSize.
+/// \param sigma The standard deviation of the spatial gaussian.
+/// \param radius The radius of the window around each pixel.
+/// \return The sum of the energies of all the pixels.
+double maskEnergy(const GLuint *texels, const GLfloat *distanceMatrix, int maskSize, int size, float sigma,
+                  int radius);
+
+/// \brief Optimize the ranking keys of a pair of dimensions, such that the first 2^k samples of the pixels are
+/// distributed as a blue noise for every power of two below spp.
+/// \note The samples of a pixel are used in the order sampleID ^ key, so the first 2^k samples of a pixel are the block
+/// of 2^k samples selected by the bits of its key above k. The bits are optimized from the highest one.
+/// \param scrambles The optimized scramble values of each pixel, 4 values per pixel.
+/// \param heavisides The heavisides used to estimate the distance between the prefixes of two pixels.
+/// \param table The samples of the sequence.
+/// \param dimension The first dimension of the pair of dimensions.
+/// \param spp The number of samples of the sequences, a power of two.
+/// \param maskSize The side of the mask, a multiple of 8.
+/// \param sigma The standard deviation of the spatial gaussian of the energy.
+/// \param radius The radius of the window of the energy, strictly below 8.
+/// \param generator The random generator used for the initial keys.
+/// \return The ranking key of each pixel.
+std::vector<GLuint> optimizeRanking(const GLuint *scrambles, const std::vector<Heaviside> &heavisides,
+                                    SequenceTable table, int dimension, int spp, int maskSize, float sigma, int radius,
+                                    Philox &generator);
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+
+// Counter-based random numbers (Philox4x32-10, Salmon et al. 2011): a block of random bits is a pure function of the
+// seed and of its position in the stream, so the loops drawing them can run in any order, on any number of threads,
+// and every run can be reproduced from its seed.
+
+/// \brief What a random stream is used for, so that the streams of the steps of the optimization never overlap.
+enum class RandomPurpose : uint32_t {
+    Permutations,    // Candidate pairs of the global proposals, shared by all the pairs of dimensions
+    Scrambles,       // Initial scrambles of the sequences of a pair of dimensions
+    Heavisides,      // Heavisides of the distance matrix of a pair of dimensions
+    Optimization,    // Shuffles of the frames, per dispatch seeds and ranking choices of a pair of dimensions
+    Ranking,         // Heavisides of the ranking of a pair of dimensions
+    ScramblePadding, // Scrambling keys of the dimensions that were not optimized
+    RankingPadding,  // Ranking keys of the dimensions that were not optimized
+    Evaluation       // Heavisides of the evaluation of an exported mask
+};
+
+class Philox {
+public:
+    using result_type = uint32_t;
+
+    using Block = std::array<uint32_t, 4>;
+
+    /// \brief Default constructor.
+    /// \param seed The seed of the run.
+    /// \param purpose What the stream is used for.
+    /// \param pair The pair of dimensions the stream is used for, 0 if it is shared by all of them.
+    explicit Philox(uint32_t seed = 0, RandomPurpose purpose = RandomPurpose::Optimization, uint32_t pair = 0) {
+        this->seed(seed, purpose, pair);
+    }
+
+    /// \brief Restart the sequential draws from the beginning of another stream.
+    /// \param seed The seed of the run.
+    /// \param purpose What the stream is used for.
+    /// \param pair The pair of dimensions the stream is used for, 0 if it is shared by all of them.
+    void seed(uint32_t seed, RandomPurpose purpose, uint32_t pair = 0) {
+        m_seed = seed;
+        m_purpose = uint32_t(purpose);
+        m_pair = pair;
+        m_index = 0;
+        m_used = 4;
+    }
+
+    /// \brief Random access to the stream.
+    /// \param index The index of the block in the stream.
+    /// \return The 128 random bits of the block.
+    Block block(uint64_t index) const {
+        Block counter = {uint32_t(index), uint32_t(index >> 32), m_pair, m_purpose};
+        uint32_t key[2] = {m_seed, 0};
+
+        for(int round = 0; round < 10; ++round) {
+            uint64_t product0 = uint64_t(0xD2511F53u) * counter[0];
+            uint64_t product1 = uint64_t(0xCD9E8D57u) * counter[2];
+
+            counter = {uint32_t(product1 >> 32) ^ counter[1] ^ key[0], uint32_t(product1),
+                       uint32_t(product0 >> 32) ^ counter[3] ^ key[1], uint32_t(product0)};
+
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+
+        return counter;
+    }
+
+    /// \brief Sequential draws, for the steps that are serial anyway (e.g. std::shuffle).
+    /// \return The next 32 random bits of the stream.
+    result_type operator()() {
+        if(m_used == 4) {
+            m_block = block(m_index++);
+            m_used = 0;
+        }
+
+        return m_block[m_used++];
+    }
+
+    static constexpr result_type min() { return 0; }
+
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+private:
+    uint32_t m_seed;
+
+    uint32_t m_purpose;
+
+    uint32_t m_pair;
+
+    uint64_t m_index; // Next block of the sequential draws
+
+    Block m_block;
+
+    int m_used; // Words of m_block already drawn
+};
+
+/// \brief Map random bits to a float in [0, 1).
+inline float uniformFloat(uint32_t bits) { return (bits >> 8) * (1.f / 16777216.f); }
+
+/// \brief Map random bits to an integer in [0, range).
+inline uint32_t uniformInteger(uint32_t bits, uint32_t range) { return uint32_t((uint64_t(bits) * range) >> 32); }
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <utils.hpp>
+
+#include <chrono>
+#include <map>
+#include <string>
+
+
+/// \brief Wall-clock, CPU and GPU time spent in each phase of the optimization, along with the memory usage.
+class Telemetry {
+public:
+    /// \brief Measure the wall-clock and CPU time of a phase until the end of the scope.
+    class Scope {
+    public:
+        /// \brief Start measuring a phase.
+        /// \param phase The name of the phase, the measures of the phases with the same name are accumulated.
+        Scope(const char *phase);
+
+        /// \brief Add the time spent since the construction to the phase.
+        ~Scope();
+
+    private:
+        const char *m_phase;
+
+        std::chrono::steady_clock::time_point m_wallStart;
+
+        double m_cpuStart;
+    };
+
+    /// \brief Start recording the measures, the GPU timer query is created in the current OpenGL context.
+    void enable();
+
+    /// \brief Free the GL ressources before the destruction of the context.
+    void freeGLRessources();
+
+    /// \brief Accessor for the state of the telemetry.
+    /// \return True if the measures are recorded.
+    bool enabled() const;
+
+    /// \brief Add a measure to a phase.
+    /// \param phase The name of the phase.
+    /// \param wallSeconds The wall-clock time of the measure.
+    /// \param cpuSeconds The CPU time of the measure, summed over all the threads.
+    void addPhase(const std::string &phase, double wallSeconds, double cpuSeconds);
+
+    /// \brief Start measuring a batch of dispatches.
+    void beginBatch();
+
+    /// \brief Start the GPU timer of a dispatch.
+    void beginDispatch();
+
+    /// \brief Stop the GPU timer of a dispatch and add its result to the current batch.
+    /// \note This waits for the dispatch to complete.
+    void endDispatch();
+
+    /// \brief Record the current batch of dispatches.
+    /// \param dimension The first dimension of the pair optimized by the batch.
+    /// \param level The resolution level optimized by the batch.
+    /// \param dispatchCount The number of dispatches in the batch.
+    /// \param acceptedSwaps The number of permutations accepted by the batch.
+    void endBatch(int dimension, int level, int dispatchCount, int acceptedSwaps);
+
+    /// \brief Set the amount of GPU memory allocated by the application.
+    /// \param bytes The size of all the buffers and textures.
+    void setAllocatedGpuMemory(GLint64 bytes);
+
+    /// \brief Query the GPU memory used according to the driver, when it exposes it.
+    void sampleGpuMemory();
+
+    /// \brief Write all the measures in a JSON file.
+    /// \param filename The name of the file.
+    /// \return False if the file could not be written.
+    bool write(const std::string &filename) const;
+
+private:
+    struct Phase {
+        int count = 0;
+
+        double wallSeconds = 0.0;
+
+        double cpuSeconds = 0.0;
+    };
+
+    struct Batch {
+        int dimension;
+
+        int level;
+
+        int dispatchCount;
+
+        int acceptedSwaps;
+
+        double wallSeconds;
+
+        double cpuSeconds;
+
+        double gpuSeconds;
+    };
+
+    bool m_enabled = false;
+
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+    std::map<std::string, Phase> m_phases;
+
+    std::vector<Batch> m_batches;
+
+    std::chrono::steady_clock::time_point m_batchWallStart;
+
+    double m_batchCpuStart = 0.0;
+
+    GLuint64 m_batchGpuTime = 0;
+
+    GLuint m_timerQuery = 0;
+
+    GLint64 m_allocatedGpuMemory = 0;
+
+    // Driver memory query (GL_NVX_gpu_memory_info or GL_ATI_meminfo), 0 if none is exposed
+    GLenum m_memoryQuery = 0;
+
+    GLint m_memoryReference = 0; // Total memory for NVX, free memory when the telemetry was enabled for ATI, in KB
+
+    GLint64 m_peakDriverGpuMemory = -1; // Negative if the driver does not report its memory usage
+};
+
+/// \brief Accessor for the telemetry of the process.
+/// \return The telemetry shared by the whole application.
+Telemetry &telemetry();
+
+/// \brief Query the CPU time of the process.
+/// \return The CPU time used by all the threads of the process, in seconds.
+double processCpuSeconds();
+
+/// \brief Query the peak resident set size of the process.
+/// \return The peak memory usage of the process, in bytes.
+int64_t peakResidentMemory();
@@ -14,6 +14,10 @@
 #define GLFW_WINDOW_ERROR -3
 #define GL_LOAD_ERROR -4
 #define GL_SSBO_SIZE_ERROR -5
+#define DISTRIBUTION_ERROR -6
+#define MASK_LOAD_ERROR -7
+#define QUALITY_GATE_ERROR -8
+#define HEADLESS_CONTEXT_ERROR -9
 
 #define LOG (std::cout << "[LOG]: ")
 #define WARN (std::cerr << "[WARN]: ")
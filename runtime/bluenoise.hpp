@@ -0,0 +1,468 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+
+// Runtime side of the blue noise masks, header only and independent of the optimizer: a batched version of the
+// sample() function of the exported headers, working either on the tables of an included header or on a mask loaded
+// at runtime. The XOR of the keys and the conversion to float are vectorized with AVX2 or NEON when the translation
+// unit is compiled for them (e.g. -mavx2), and give the same floats as the exported sample() function.
+//
+// The masks are optimized for one of two sequences: the precomputed 4096x256 table of sobol_4096spp_256d.h, or a
+// table-free Owen scrambled Sobol sequence generated on the fly, which keeps the 4 MB table out of the caches.
+
+namespace bluenoise {
+
+/// \brief First line of the exported headers, recording the parameters needed to read the tables back.
+/// \note The sequence is 0 for the table and 1 for the table-free one, the layout 0 for the rows and 1 for the Morton
+/// curve. The headers that do not record them use the table and the rows.
+static const char *const MetadataFormat = "// Bluenoise mask: size %d, frames %d, dimensions %d, total dimensions %d, "
+                                          "spp %d, ranking %d, sequence %d, layout %d\n";
+
+/// \brief Declared number of scrambling keys per pixel in the exported headers, only the first totalDimensions are set.
+constexpr int ScramblingKeyExtent = 256;
+
+/// \brief Number of dimensions of the sequence sampled through the masks.
+constexpr int SequenceDimensions = 256;
+
+/// \brief Number of samples of the sequence sampled through the masks.
+constexpr int SequenceSamples = 4096;
+
+/// \brief The sequence the scrambling keys of a mask are applied to.
+enum class Sequence {
+    Table,    // The precomputed table of sobol_4096spp_256d.h
+    SobolOwen // The first two dimensions of Sobol, Owen scrambled independently for each pair of dimensions
+};
+
+/// \brief The order the pixels of a mask are stored in.
+enum class Layout {
+    Rows,  // Row by row, with ScramblingKeyExtent keys per pixel
+    Morton // Along the Morton curve, so that every aligned power of two tile is contiguous, with only the keys used
+};
+
+/// \brief Spread the 16 low bits of an integer over its even bits.
+inline uint32_t spreadBits(uint32_t x) {
+    x &= 0x0000FFFFU;
+    x = (x | (x << 8)) & 0x00FF00FFU;
+    x = (x | (x << 4)) & 0x0F0F0F0FU;
+    x = (x | (x << 2)) & 0x33333333U;
+    x = (x | (x << 1)) & 0x55555555U;
+
+    return x;
+}
+
+/// \brief Gather the even bits of an integer in its 16 low bits.
+inline uint32_t compactBits(uint32_t x) {
+    x &= 0x55555555U;
+    x = (x | (x >> 1)) & 0x33333333U;
+    x = (x | (x >> 2)) & 0x0F0F0F0FU;
+    x = (x | (x >> 4)) & 0x00FF00FFU;
+    x = (x | (x >> 8)) & 0x0000FFFFU;
+
+    return x;
+}
+
+/// \brief Compute the position of a pixel along the Morton curve.
+/// \param i The row of the pixel.
+/// \param j The column of the pixel.
+/// \return The position of the pixel, its column in the even bits and its row in the odd ones.
+inline uint32_t mortonIndex(uint32_t i, uint32_t j) { return spreadBits(j) | (spreadBits(i) << 1); }
+
+/// \brief Find the pixel at a position of the Morton curve.
+/// \param index The position along the curve.
+/// \param i The row of the pixel.
+/// \param j The column of the pixel.
+inline void mortonCoordinates(uint32_t index, uint32_t &i, uint32_t &j) {
+    i = compactBits(index >> 1);
+    j = compactBits(index);
+}
+
+/// \brief Reverse the order of the bits of an integer.
+inline uint32_t reverseBits(uint32_t x) {
+    x = (x << 16) | (x >> 16);
+    x = ((x & 0x00FF00FFU) << 8) | ((x & 0xFF00FF00U) >> 8);
+    x = ((x & 0x0F0F0F0FU) << 4) | ((x & 0xF0F0F0F0U) >> 4);
+    x = ((x & 0x33333333U) << 2) | ((x & 0xCCCCCCCCU) >> 2);
+    x = ((x & 0x55555555U) << 1) | ((x & 0xAAAAAAAAU) >> 1);
+
+    return x;
+}
+
+/// \brief Hash an integer (lowbias32 by C. Wellons).
+inline uint32_t hash(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7FEB352DU;
+    x ^= x >> 15;
+    x *= 0x846CA68BU;
+    x ^= x >> 16;
+
+    return x;
+}
+
+/// \brief Generate a sample of the table-free sequence.
+/// \note Each pair of dimensions is a (0, 2)-sequence: the first two dimensions of Sobol, the first one being the van der
+/// Corput sequence and the second one the product of the index with the Pascal matrix. The pairs are decorrelated by
+/// XORing the index with a per pair constant, which keeps the aligned blocks of samples together like the ranking
+/// keys, and by Owen scrambling each dimension with its own seed, using the hash based permutation of Laine and Karras
+/// improved by Burley. The samples are generated with their bits reversed, the order the permutation works in.
+/// \param index The index of the sample, below SequenceSamples.
+/// \param d The dimension, below SequenceDimensions.
+/// \return The sample, as a 32 bit fixed point number.
+inline uint32_t sobolOwen(uint32_t index, int d) {
+    const uint32_t seed = hash(uint32_t(d >> 1) + 0x9E3779B9U);
+    index ^= seed & (SequenceSamples - 1);
+
+    // The van der Corput sequence is the reversed index. The reversed direction numbers of the second dimension are the
+    // GF(2) polynomials v[k] = (1 + x)^k, so a nibble of the index at bit 4t contributes (1 + x^4)^t (1 + x)^b summed
+    // over its bits b: the nibble sums are tabulated, and (1 + x^4)^t is a multiplication by 0x1, 0x11 or 0x101.
+    static const uint32_t NibbleDirections[16] = {0, 1, 3, 2, 5, 4, 6, 7, 15, 14, 12, 13, 10, 11, 9, 8};
+
+    uint32_t x = index;
+    if(d & 1)
+        x = NibbleDirections[index & 15] ^ NibbleDirections[(index >> 4) & 15] * 0x11U ^
+            NibbleDirections[(index >> 8) & 15] * 0x101U;
+
+    x += hash(seed ^ uint32_t(d & 1));
+    x ^= x * 0x6C50B47CU;
+    x ^= x * 0xB82F1E52U;
+    x ^= x * 0xC7AFE638U;
+    x ^= x * 0x8D22F6E6U;
+
+    return reverseBits(x);
+}
+
+/// \brief A mask loaded from an exported header.
+struct MaskData {
+    int size = 0;
+
+    int frames = 1;
+
+    int dimensions = 0; // Optimized dimensions, the others are randomly scrambled
+
+    int totalDimensions = 0;
+
+    int spp = 0;
+
+    Sequence sequence = Sequence::Table;
+
+    Layout layout = Layout::Rows;
+
+    std::vector<uint32_t> scramblingKeys; // totalDimensions keys per pixel of each frame, the pixels in layout order
+
+    std::vector<uint16_t> rankingKeys; // totalDimensions / 2 keys per pixel of each frame in layout order, or nothing
+};
+
+namespace detail {
+
+/// \brief Parse the values of a table of an exported header.
+/// \param text The content of the header.
+/// \param name The name of the table.
+/// \param values The values of the table, in the order they were exported.
+/// \return False if the table was not found or holds a different number of values.
+template <typename T>
+inline bool readTable(const std::string &text, const char *name, std::vector<T> &values) {
+    size_t position = text.find(name);
+    if(position == std::string::npos)
+        return false;
+
+    // Skip the dimensions of the declaration
+    position = text.find('=', position);
+    if(position == std::string::npos)
+        return false;
+
+    size_t end = text.find("};", position);
+    if(end == std::string::npos)
+        return false;
+
+    size_t count = 0;
+    const char *c = text.c_str() + position;
+    const char *last = text.c_str() + end;
+    while(c < last) {
+        if(*c < '0' || *c > '9') {
+            ++c;
+            continue;
+        }
+
+        char *next;
+        unsigned long value = std::strtoul(c, &next, 10);
+        if(count == values.size())
+            return false;
+
+        values[count++] = T(value);
+        c = next;
+    }
+
+    return count == values.size();
+}
+
+/// \brief Convert scrambled samples to floats in [0, 1], exactly like the exported sample() function (1 is included
+/// because float(0xFFFFFFFF) rounds to 2^32).
+/// \param keys The scrambling keys.
+/// \param sequence The samples of the sequence.
+/// \param count The number of samples.
+/// \param samples The converted samples.
+inline void scrambleAndConvert(const uint32_t *keys, const uint32_t *sequence, int count, float *samples) {
+    const float Scale = 1.f / 4294967296.f;
+
+    int k = 0;
+
+#if defined(__AVX2__)
+    // There is no unsigned conversion before AVX-512: both exact 16 bit halves are converted, the sum being rounded once
+    const __m256i low = _mm256_set1_epi32(0xFFFF);
+    const __m256 high = _mm256_set1_ps(65536.f);
+    const __m256 half = _mm256_set1_ps(0.5f);
+    const __m256 scale = _mm256_set1_ps(Scale);
+
+    for(; k + 8 <= count; k += 8) {
+        __m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(keys + k)),
+                                     _mm256_loadu_si256((const __m256i *)(sequence + k)));
+
+        __m256 f = _mm256_add_ps(_mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(v, 16)), high),
+                                 _mm256_cvtepi32_ps(_mm256_and_si256(v, low)));
+
+        _mm256_storeu_ps(samples + k, _mm256_mul_ps(_mm256_add_ps(f, half), scale));
+    }
+#elif defined(__ARM_NEON)
+    const float32x4_t half = vdupq_n_f32(0.5f);
+
+    for(; k + 4 <= count; k += 4) {
+        uint32x4_t v = veorq_u32(vld1q_u32(keys + k), vld1q_u32(sequence + k));
+
+        vst1q_f32(samples + k, vmulq_n_f32(vaddq_f32(vcvtq_f32_u32(v), half), Scale));
+    }
+#endif
+
+    for(; k < count; ++k)
+        samples[k] = (float(sequence[k] ^ keys[k]) + 0.5f) * Scale;
+}
+
+} // namespace detail
+
+/// \brief Load a mask exported by the optimizer.
+/// \param filename The name of the exported header.
+/// \param mask The loaded mask.
+/// \return False if the file could not be read or was not exported by the optimizer.
+inline bool loadMask(const char *filename, MaskData &mask) {
+    std::ifstream file(filename);
+    if(!file)
+        return false;
+
+    std::string line;
+    std::getline(file, line);
+    line += '\n';
+
+    int ranking;
+    int sequence = 0;
+    int layout = 0;
+    if(std::sscanf(line.c_str(), MetadataFormat, &mask.size, &mask.frames, &mask.dimensions, &mask.totalDimensions,
+                   &mask.spp, &ranking, &sequence, &layout) < 6)
+        return false;
+
+    // The metadata sizes the tables, it is checked against the ranges of the optimizer before allocating them
+    auto isPowerOfTwo = [](int n) { return n > 0 && (n & (n - 1)) == 0; };
+    if(!isPowerOfTwo(mask.size) || mask.frames < 1 || mask.frames > 16384 / mask.size || mask.dimensions < 2 ||
+       mask.dimensions % 2 != 0 || mask.dimensions > mask.totalDimensions || !isPowerOfTwo(mask.totalDimensions) ||
+       mask.totalDimensions > SequenceDimensions || mask.spp < 1 || mask.spp > SequenceSamples ||
+       (sequence != 0 && sequence != 1) || (layout != 0 && layout != 1))
+        return false;
+    mask.sequence = sequence != 0 ? Sequence::SobolOwen : Sequence::Table;
+    mask.layout = layout != 0 ? Layout::Morton : Layout::Rows;
+
+    std::stringstream content;
+    content << file.rdbuf();
+    const std::string text = content.str();
+
+    const size_t texelCount = size_t(mask.size) * mask.size * mask.frames;
+
+    mask.scramblingKeys.assign(texelCount * mask.totalDimensions, 0U);
+    if(!detail::readTable(text, "scramblingKeys", mask.scramblingKeys))
+        return false;
+
+    mask.rankingKeys.clear();
+    if(ranking) {
+        mask.rankingKeys.assign(texelCount * (mask.totalDimensions / 2), 0U);
+        if(!detail::readTable(text, "rankingKeys", mask.rankingKeys))
+            return false;
+
+        // The keys select samples of the sequence, they must remain below the sample count
+        for(uint16_t key : mask.rankingKeys)
+            if(key >= mask.spp)
+                return false;
+    }
+
+    return true;
+}
+
+/// \brief Batched sampler of a mask.
+/// \note The sampler only references the tables of the mask and the sequence, which must outlive it.
+class Sampler {
+public:
+    /// \brief Sample the tables of an included exported header.
+    /// \param scramblingKeys The first key of the scramblingKeys table.
+    /// \param rankingKeys The first key of the rankingKeys table, or nullptr if the mask has none.
+    /// \param size The side of the mask.
+    /// \param frames The number of frames of the mask.
+    /// \param totalDimensions The number of dimensions of the mask, a power of two.
+    /// \param sequence The sequence table of the exported header, or nullptr for a mask of the table-free sequence.
+    /// \param layout The order the pixels of the tables are stored in.
+    Sampler(const uint32_t *scramblingKeys, const uint16_t *rankingKeys, int size, int frames, int totalDimensions,
+            const uint32_t (*sequence)[SequenceDimensions], Layout layout = Layout::Rows)
+        : m_scramblingKeys(scramblingKeys), m_rankingKeys(rankingKeys), m_sequence(sequence), m_size(size),
+          m_frames(frames), m_totalDimensions(totalDimensions),
+          m_scrambleStride(layout == Layout::Morton ? totalDimensions : ScramblingKeyExtent), m_layout(layout) {}
+
+    /// \brief Sample a mask loaded at runtime.
+    /// \param mask The loaded mask.
+    /// \param sequence The sequence table of the exported header, ignored for a mask of the table-free sequence.
+    Sampler(const MaskData &mask, const uint32_t (*sequence)[SequenceDimensions] = nullptr)
+        : m_scramblingKeys(mask.scramblingKeys.data()),
+          m_rankingKeys(mask.rankingKeys.empty() ? nullptr : mask.rankingKeys.data()),
+          m_sequence(mask.sequence == Sequence::Table ? sequence : nullptr),
+          m_size(mask.size), m_frames(mask.frames), m_totalDimensions(mask.totalDimensions),
+          m_scrambleStride(mask.totalDimensions), m_layout(mask.layout) {}
+
+    /// \brief Draw a single sample, same as the exported sample() function.
+    /// \param i The row of the pixel, wrapping around the mask.
+    /// \param j The column of the pixel, wrapping around the mask.
+    /// \param frame The frame, wrapping around the mask.
+    /// \param sampleID The index of the sample.
+    /// \param d The dimension, wrapping around the dimensions of the mask.
+    /// \return The sample in [0, 1], 1 being included because float(0xFFFFFFFF) rounds to 2^32.
+    float sample(int i, int j, int frame, int sampleID, int d) const {
+        const size_t texel = texelIndex(i, j, frame);
+        d &= m_totalDimensions - 1;
+
+        uint32_t index = m_rankingKeys ? sampleID ^ m_rankingKeys[texel * (m_totalDimensions / 2) + (d >> 1)] : sampleID;
+        uint32_t sample = m_sequence ? m_sequence[index][d] : sobolOwen(index, d);
+
+        return (float(sample ^ m_scramblingKeys[texel * m_scrambleStride + d]) + 0.5f) * (1.f / 4294967296.f);
+    }
+
+    /// \brief Draw consecutive dimensions of a sample for a list of pixels.
+    /// \param i The rows of the pixels.
+    /// \param j The columns of the pixels.
+    /// \param pixelCount The number of pixels.
+    /// \param frame The frame.
+    /// \param sampleID The index of the sample.
+    /// \param firstDimension The first dimension to draw.
+    /// \param dimensionCount The number of dimensions to draw.
+    /// \param samples The samples, dimensionCount per pixel.
+    void samplePixels(const int *i, const int *j, int pixelCount, int frame, int sampleID, int firstDimension,
+                      int dimensionCount, float *samples) const {
+        uint32_t buffer[SequenceDimensions];
+        const uint32_t *row = sequenceRow(sampleID, firstDimension, dimensionCount, buffer);
+
+        for(int p = 0; p < pixelCount; ++p)
+            samplePixel(i[p], j[p], frame, sampleID, firstDimension, dimensionCount, row,
+                        samples + size_t(p) * dimensionCount);
+    }
+
+    /// \brief Draw consecutive dimensions of a sample for a tile of pixels.
+    /// \param i The first row of the tile.
+    /// \param j The first column of the tile.
+    /// \param rows The number of rows of the tile.
+    /// \param columns The number of columns of the tile.
+    /// \param frame The frame.
+    /// \param sampleID The index of the sample.
+    /// \param firstDimension The first dimension to draw.
+    /// \param dimensionCount The number of dimensions to draw.
+    /// \param samples The samples, dimensionCount per pixel, the pixels being stored row by row.
+    void sampleTile(int i, int j, int rows, int columns, int frame, int sampleID, int firstDimension,
+                    int dimensionCount, float *samples) const {
+        uint32_t buffer[SequenceDimensions];
+        const uint32_t *row = sequenceRow(sampleID, firstDimension, dimensionCount, buffer);
+
+        for(int r = 0; r < rows; ++r)
+            for(int c = 0; c < columns; ++c)
+                samplePixel(i + r, j + c, frame, sampleID, firstDimension, dimensionCount, row,
+                            samples + (size_t(r) * columns + c) * dimensionCount);
+    }
+
+private:
+    size_t texelIndex(int i, int j, int frame) const {
+        const uint32_t row = uint32_t(i) & (m_size - 1);
+        const uint32_t column = uint32_t(j) & (m_size - 1);
+        const size_t pixel = m_layout == Layout::Morton ? mortonIndex(row, column) : size_t(row) * m_size + column;
+
+        return size_t(frame % m_frames) * m_size * m_size + pixel;
+    }
+
+    /// \brief Gather the samples of the sequence shared by all the pixels, which is only the case without ranking keys.
+    /// \param buffer The storage of the table-free samples, SequenceDimensions values.
+    /// \return The sample of each dimension, nullptr if the pixels have their own order of the samples.
+    const uint32_t *sequenceRow(int sampleID, int firstDimension, int dimensionCount, uint32_t *buffer) const {
+        if(m_rankingKeys)
+            return nullptr;
+
+        if(m_sequence)
+            return m_sequence[sampleID];
+
+        // The table-free samples are generated once for all the pixels
+        for(int m = 0; m < std::min(dimensionCount, m_totalDimensions); ++m) {
+            int d = (firstDimension + m) & (m_totalDimensions - 1);
+            buffer[d] = sobolOwen(sampleID, d);
+        }
+
+        return buffer;
+    }
+
+    void samplePixel(int i, int j, int frame, int sampleID, int firstDimension, int dimensionCount,
+                     const uint32_t *row, float *samples) const {
+        const size_t texel = texelIndex(i, j, frame);
+        const uint32_t *keys = m_scramblingKeys + texel * m_scrambleStride;
+
+        // The dimensions wrap around, so they are drawn by contiguous runs
+        for(int m = 0; m < dimensionCount;) {
+            int d = (firstDimension + m) & (m_totalDimensions - 1);
+            int run = std::min(dimensionCount - m, m_totalDimensions - d);
+
+            if(row)
+                detail::scrambleAndConvert(keys + d, row + d, run, samples + m);
+            else {
+                // Each pair of dimensions uses the samples in its own order
+                const uint16_t *ranks = m_rankingKeys + texel * (m_totalDimensions / 2);
+
+                uint32_t sequence[SequenceDimensions];
+                for(int k = 0; k < run; ++k) {
+                    uint32_t index = sampleID ^ ranks[(d + k) >> 1];
+                    sequence[k] = m_sequence ? m_sequence[index][d + k] : sobolOwen(index, d + k);
+                }
+
+                detail::scrambleAndConvert(keys + d, sequence, run, samples + m);
+            }
+
+            m += run;
+        }
+    }
+
+    const uint32_t *m_scramblingKeys;
+
+    const uint16_t *m_rankingKeys;
+
+    const uint32_t (*m_sequence)[SequenceDimensions]; // nullptr for the table-free sequence
+
+    int m_size;
+
+    int m_frames;
+
+    int m_totalDimensions;
+
+    int m_scrambleStride;
+
+    Layout m_layout;
+};
+
+} // namespace bluenoise
@@ -0,0 +1,146 @@
+#include <autotune.hpp>
+#include <telemetry.hpp>
+
+#include <algorithm>
+
+
+// Candidates of the tuning: the warp and wavefront sizes of the GPUs and their multiples, and up to 4 times fewer
+// swap attempts than pixels
+static const int WorkGroupSizes[] = {16, 32, 64, 128, 256};
+static const int SwapAttemptsDivisors[] = {1, 2, 4};
+
+/// \brief The fastest work group size of a device for a mask size and a swap attempts count.
+struct TunedParameters {
+    int maskSize;
+
+    int swapAttemptsDivisor;
+
+    int workGroupSize;
+
+    double nanoseconds; // GPU time per attempted swap
+
+    std::string device;
+};
+
+/// \brief Read the tuned parameters of all the devices.
+/// \param filename The name of the cache file.
+/// \return The entries of the cache, none if it does not exist.
+static std::vector<TunedParameters> readCache(const std::string &filename) {
+    std::vector<TunedParameters> entries;
+
+    std::ifstream file(filename);
+    std::string line;
+    while(std::getline(file, line)) {
+        // Skip the empty lines and the comments
+        if(line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#')
+            continue;
+
+        TunedParameters entry;
+        std::istringstream stream(line);
+        if(!(stream >> entry.maskSize >> entry.swapAttemptsDivisor >> entry.workGroupSize >> entry.nanoseconds)) {
+            WARN << "Invalid entry \"" << line << "\" in " << filename << ", it is ignored" << std::endl;
+
+            continue;
+        }
+
+        // The device string takes the rest of the line
+        std::getline(stream >> std::ws, entry.device);
+        entries.push_back(entry);
+    }
+
+    return entries;
+}
+
+/// \brief Write the tuned parameters of all the devices.
+/// \param filename The name of the cache file.
+/// \param entries The entries of the cache.
+/// \return False if the file could not be written.
+static bool writeCache(const std::string &filename, const std::vector<TunedParameters> &entries) {
+    std::ofstream file(filename);
+
+    file << "# MaskSize SwapAttemptsDivisor WorkGroupSize NanosecondsPerSwapAttempt Device\n";
+    for(const TunedParameters &entry : entries)
+        file << entry.maskSize << " " << entry.swapAttemptsDivisor << " " << entry.workGroupSize << " "
+             << entry.nanoseconds << " " << entry.device << "\n";
+
+    return bool(file);
+}
+
+std::string deviceString() {
+    // The version string holds the version of the driver
+    return std::string((const char *)glGetString(GL_RENDERER)) + ", " + (const char *)glGetString(GL_VERSION);
+}
+
+void autotune(Optimizer &optimizer, OptimizerSettings &settings, const std::string &cacheFile, bool tuneSwapAttempts) {
+    Telemetry::Scope scope("autotune");
+
+    const std::string device = deviceString();
+
+    GLint maxInvocations, maxSize;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxSize);
+
+    std::vector<int> divisors;
+    if(tuneSwapAttempts) {
+        // The tiles of the local proposals need a pair of pixels at least
+        for(int divisor : SwapAttemptsDivisors)
+            if(settings.proposal == Proposal::Global || settings.tileSize * settings.tileSize >= 2 * divisor)
+                divisors.push_back(divisor);
+    } else
+        divisors.push_back(settings.swapAttemptsDivisor);
+
+    std::vector<TunedParameters> entries = readCache(cacheFile);
+    bool updated = false;
+
+    int fastest = -1; // Index of the fastest entry, the entries growing as the parameters are timed
+    for(int divisor : divisors) {
+        auto cached = std::find_if(entries.begin(), entries.end(), [&](const TunedParameters &entry) {
+            return entry.device == device && entry.maskSize == settings.maskSize &&
+                   entry.swapAttemptsDivisor == divisor;
+        });
+
+        if(cached == entries.end()) {
+            LOG << "Timing the dispatches testing 1 pixel out of " << divisor << " on " << device << "..."
+                << std::endl;
+
+            TunedParameters entry{settings.maskSize, divisor, 0, 0.0, device};
+            for(int workGroupSize : WorkGroupSizes) {
+                if(workGroupSize > maxInvocations || workGroupSize > maxSize)
+                    continue;
+
+                double nanoseconds = optimizer.timeDispatches(workGroupSize, divisor);
+                LOG << "    Work groups of " << workGroupSize << ": " << nanoseconds << "ns per swap attempt"
+                    << std::endl;
+
+                if(entry.workGroupSize == 0 || nanoseconds < entry.nanoseconds) {
+                    entry.workGroupSize = workGroupSize;
+                    entry.nanoseconds = nanoseconds;
+                }
+            }
+
+            entries.push_back(entry);
+            cached = entries.end() - 1;
+            updated = true;
+        }
+
+        if(fastest < 0 || cached->nanoseconds < entries[fastest].nanoseconds)
+            fastest = int(cached - entries.begin());
+    }
+
+    if(updated && !writeCache(cacheFile, entries))
+        WARN << "Could not write the tuned dispatch parameters in " << cacheFile << std::endl;
+
+    const TunedParameters &best = entries[fastest];
+    settings.workGroupSize = best.workGroupSize;
+    settings.swapAttemptsDivisor = best.swapAttemptsDivisor;
+    optimizer.setDispatchParameters(settings.workGroupSize, settings.swapAttemptsDivisor);
+
+    LOG << "Dispatch parameters of " << device << ": work groups of " << settings.workGroupSize
+        << ", 1 pixel out of " << settings.swapAttemptsDivisor << " tested per dispatch (" << best.nanoseconds
+        << "ns per swap attempt)" << std::endl;
+
+    // The divisor is picked by throughput alone, not by the energy it reaches
+    if(tuneSwapAttempts)
+        LOG << "The swap divisor changes the masks: --swap-divisor " << settings.swapAttemptsDivisor
+            << " reproduces them on other devices" << std::endl;
+}
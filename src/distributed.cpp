@@ -0,0 +1,224 @@
+#include <distributed.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+
+static const char PlaneMagic[4] = {'B', 'N', 'K', 'P'};
+
+static std::string jobFile(const std::string &directory, int job) {
+    return directory + "/job" + std::to_string(job) + ".txt";
+}
+
+static std::string claimFile(const std::string &directory, const Task &task) {
+    return directory + "/job" + std::to_string(task.job) + "_pair" + std::to_string(task.pair) + ".claim";
+}
+
+bool publishJob(const std::string &directory, int job, const OptimizerSettings &settings, int threshold) {
+    std::ofstream file(jobFile(directory, job));
+
+    const char *proposals[] = {"global", "local", "hybrid"};
+
+    file << "maskSize " << settings.maskSize << "\n";
+    file << "dimensions " << settings.dimensions << "\n";
+    file << "totalDimensions " << settings.totalDimensions << "\n";
+    file << "spp " << settings.spp << "\n";
+    file << "proposal " << proposals[int(settings.proposal)] << "\n";
+    file << "heavisideBank " << int(settings.heavisideBank) << "\n";
+    file << "heavisideCount " << settings.heavisideCount << "\n";
+    file << "orientationBins " << settings.orientationBins << "\n";
+    file << "tileSize " << settings.tileSize << "\n";
+    file << "swapAttemptsDivisor " << settings.swapAttemptsDivisor << "\n";
+    file << "levels " << settings.levels << "\n";
+    file << "seed " << settings.seed << "\n";
+    file << "ranking " << int(settings.ranking) << "\n";
+    file << "frames " << settings.frames << "\n";
+    file << "sequence " << int(settings.sequence) << "\n";
+    file << "layout " << int(settings.layout) << "\n";
+    file << "threshold " << threshold << "\n";
+
+    return bool(file);
+}
+
+bool publishJobCount(const std::string &directory, int jobCount) {
+    // Written last, so that the workers never see a partially published list
+    std::string filename = directory + "/jobs.txt";
+    {
+        std::ofstream file(filename + ".tmp");
+        file << jobCount << "\n";
+
+        if(!file)
+            return false;
+    }
+
+    return std::rename((filename + ".tmp").c_str(), filename.c_str()) == 0;
+}
+
+int publishedJobCount(const std::string &directory) {
+    std::ifstream file(directory + "/jobs.txt");
+
+    int jobCount = 0;
+    if(!(file >> jobCount))
+        return 0;
+
+    return jobCount;
+}
+
+bool readPublishedJob(const std::string &directory, int job, OptimizerSettings &settings, int &threshold) {
+    std::ifstream file(jobFile(directory, job));
+    if(!file)
+        return false;
+
+    std::string key;
+    while(file >> key) {
+        if(key == "maskSize")
+            file >> settings.maskSize;
+        else if(key == "dimensions")
+            file >> settings.dimensions;
+        else if(key == "totalDimensions")
+            file >> settings.totalDimensions;
+        else if(key == "spp")
+            file >> settings.spp;
+        else if(key == "proposal") {
+            std::string proposal;
+            file >> proposal;
+
+            settings.proposal = proposal == "local"    ? Proposal::Local
+                                : proposal == "hybrid" ? Proposal::Hybrid
+                                                       : Proposal::Global;
+        } else if(key == "heavisideBank") {
+            int bank;
+            file >> bank;
+
+            settings.heavisideBank = HeavisideBank(bank);
+        } else if(key == "heavisideCount")
+            file >> settings.heavisideCount;
+        else if(key == "orientationBins")
+            file >> settings.orientationBins;
+        else if(key == "tileSize")
+            file >> settings.tileSize;
+        else if(key == "swapAttemptsDivisor")
+            file >> settings.swapAttemptsDivisor;
+        else if(key == "levels")
+            file >> settings.levels;
+        else if(key == "seed")
+            file >> settings.seed;
+        else if(key == "ranking")
+            file >> settings.ranking;
+        else if(key == "frames")
+            file >> settings.frames;
+        else if(key == "sequence") {
+            int sequence;
+            file >> sequence;
+
+            settings.sequence = bluenoise::Sequence(sequence);
+        } else if(key == "layout") {
+            int layout;
+            file >> layout;
+
+            settings.layout = bluenoise::Layout(layout);
+        }
+        else if(key == "threshold")
+            file >> threshold;
+        else {
+            ERROR << "Unknown key " << key << " in " << jobFile(directory, job) << std::endl;
+
+            return false;
+        }
+    }
+
+    return !file.bad();
+}
+
+bool claimTask(const std::string &directory, int jobCount, int pairCount, Task &task) {
+    for(int job = 0; job < jobCount; ++job) {
+        for(int pair = 0; pair < pairCount; ++pair) {
+            task = {job, pair};
+
+            // The exclusive creation fails if another worker already claimed the pair
+            FILE *claim = std::fopen(claimFile(directory, task).c_str(), "wx");
+            if(claim) {
+                std::fclose(claim);
+
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+std::string planeFile(const std::string &directory, const Task &task) {
+    return directory + "/job" + std::to_string(task.job) + "_pair" + std::to_string(task.pair) + ".plane";
+}
+
+bool writePlane(const std::string &filename, const OptimizerSettings &settings, int dimension,
+                const std::vector<GLuint> &scrambles, const std::vector<GLuint> &rankings) {
+    const int texelCount = settings.maskSize * settings.maskSize * settings.frames;
+
+    std::vector<GLuint> plane(2 * texelCount);
+    for(int i = 0; i < texelCount; ++i) {
+        plane[2 * i] = scrambles[i * settings.dimensions + dimension];
+        plane[2 * i + 1] = scrambles[i * settings.dimensions + dimension + 1];
+    }
+
+    std::vector<GLuint> ranking;
+    for(int i = 0; i < texelCount && !rankings.empty(); ++i)
+        ranking.push_back(rankings[i * (settings.dimensions / 2) + dimension / 2]);
+
+    {
+        std::ofstream file(filename + ".tmp", std::ios::binary);
+
+        int32_t header[4] = {settings.maskSize, settings.frames, dimension, int32_t(!ranking.empty())};
+        file.write(PlaneMagic, sizeof(PlaneMagic));
+        file.write((const char *)header, sizeof(header));
+        file.write((const char *)plane.data(), sizeof(GLuint) * plane.size());
+        file.write((const char *)ranking.data(), sizeof(GLuint) * ranking.size());
+
+        if(!file)
+            return false;
+    }
+
+    return std::rename((filename + ".tmp").c_str(), filename.c_str()) == 0;
+}
+
+bool readPlane(const std::string &filename, const OptimizerSettings &settings, std::vector<GLuint> &scrambles,
+               std::vector<GLuint> &rankings) {
+    std::ifstream file(filename, std::ios::binary);
+
+    char magic[4];
+    int32_t header[4];
+    file.read(magic, sizeof(magic));
+    file.read((char *)header, sizeof(header));
+
+    if(!file || std::memcmp(magic, PlaneMagic, sizeof(magic)) != 0)
+        return false;
+
+    const int dimension = header[2];
+    if(header[0] != settings.maskSize || header[1] != settings.frames || dimension < 0 ||
+       dimension + 1 >= settings.dimensions) {
+        ERROR << "The plane " << filename << " does not match the settings of its job" << std::endl;
+
+        return false;
+    }
+
+    const int texelCount = settings.maskSize * settings.maskSize * settings.frames;
+
+    std::vector<GLuint> plane(2 * texelCount);
+    file.read((char *)plane.data(), sizeof(GLuint) * plane.size());
+    for(int i = 0; i < texelCount; ++i) {
+        scrambles[i * settings.dimensions + dimension] = plane[2 * i];
+        scrambles[i * settings.dimensions + dimension + 1] = plane[2 * i + 1];
+    }
+
+    if(header[3] != 0) {
+        std::vector<GLuint> ranking(texelCount);
+        file.read((char *)ranking.data(), sizeof(GLuint) * ranking.size());
+
+        rankings.resize((settings.dimensions / 2) * texelCount, 0U);
+        for(int i = 0; i < texelCount; ++i)
+            rankings[i * (settings.dimensions / 2) + dimension / 2] = ranking[i];
+    }
+
+    return bool(file);
+}
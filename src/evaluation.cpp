@@ -0,0 +1,157 @@
+#include <evaluation.hpp>
+
+
+/// \brief Compute the discrete Fourier transform of a power of two number of values in place (iterative radix-2).
+/// \param data The first value.
+/// \param stride The distance between two consecutive values.
+/// \param size The number of values.
+static void fft1D(std::complex<double> *data, int stride, int size) {
+    // Bit reversal permutation
+    for(int i = 1, j = 0; i < size; ++i) {
+        int bit = size >> 1;
+        for(; j & bit; bit >>= 1)
+            j ^= bit;
+        j ^= bit;
+
+        if(i < j)
+            std::swap(data[i * stride], data[j * stride]);
+    }
+
+    const double PI = 3.14159265358979323846;
+    for(int length = 2; length <= size; length <<= 1) {
+        const std::complex<double> root = std::polar(1.0, -2.0 * PI / length);
+
+        for(int i = 0; i < size; i += length) {
+            std::complex<double> w = 1.0;
+
+            for(int k = 0; k < length / 2; ++k) {
+                std::complex<double> even = data[(i + k) * stride];
+                std::complex<double> odd = data[(i + k + length / 2) * stride] * w;
+
+                data[(i + k) * stride] = even + odd;
+                data[(i + k + length / 2) * stride] = even - odd;
+                w *= root;
+            }
+        }
+    }
+}
+
+/// \brief Map a frequency index of the transform to its signed frequency.
+static inline int signedFrequency(int k, int size) { return k < size / 2 ? k : k - size; }
+
+
+void errorImage(const EvaluatedMask &mask, const Heaviside &heaviside, int dimension, int frame, int spp,
+                std::vector<double> &error) {
+    const OptimizerSettings &settings = mask.settings;
+    const int pixelCount = settings.maskSize * settings.maskSize;
+    const SequenceTable table = sequenceTable(settings.sequence);
+
+    error.resize(pixelCount);
+
+    double mean = 0.0;
+
+#pragma omp parallel for reduction(+ : mean)
+    for(int i = 0; i < pixelCount; ++i) {
+        size_t texel = size_t(frame) * pixelCount + i;
+
+        // The first spp samples of the ranked order are the block of spp samples selected by the key
+        int firstSample = 0;
+        if(!mask.rankings.empty())
+            firstSample = int(mask.rankings[texel * (settings.totalDimensions / 2) + dimension / 2]) & ~(spp - 1);
+
+        error[i] = integrateHeaviside(&mask.scrambles[texel * settings.totalDimensions + dimension], heaviside, table,
+                                      dimension, spp, firstSample);
+        mean += error[i];
+    }
+    mean /= pixelCount;
+
+    for(double &e : error)
+        e -= mean;
+}
+
+void fft2D(std::vector<std::complex<double>> &data, int size) {
+#pragma omp parallel for
+    for(int row = 0; row < size; ++row)
+        fft1D(&data[size_t(row) * size], 1, size);
+
+#pragma omp parallel for
+    for(int column = 0; column < size; ++column)
+        fft1D(&data[column], size, size);
+}
+
+void accumulatePowerSpectrum(const std::vector<double> &image, int size, std::vector<double> &power) {
+    std::vector<std::complex<double>> data(image.begin(), image.end());
+    fft2D(data, size);
+
+    const double normalization = 1.0 / (double(size) * size);
+
+    power.resize(data.size(), 0.0);
+    for(size_t i = 0; i < data.size(); ++i)
+        power[i] += std::norm(data[i]) * normalization;
+}
+
+RadialSpectrum radialAverage(const std::vector<double> &power, int size) {
+    const int radiusCount = size / 2 + 1;
+
+    std::vector<double> sum(radiusCount, 0.0);
+    std::vector<double> sumSquares(radiusCount, 0.0);
+    std::vector<int> count(radiusCount, 0);
+
+    for(int y = 0; y < size; ++y) {
+        for(int x = 0; x < size; ++x) {
+            int fx = signedFrequency(x, size);
+            int fy = signedFrequency(y, size);
+            int radius = int(std::lround(std::sqrt(double(fx * fx + fy * fy))));
+
+            // The corners beyond the Nyquist frequency only hold partial annuli
+            if(radius >= radiusCount)
+                continue;
+
+            double p = power[size_t(y) * size + x];
+            sum[radius] += p;
+            sumSquares[radius] += p * p;
+            ++count[radius];
+        }
+    }
+
+    RadialSpectrum spectrum;
+    spectrum.power.resize(radiusCount);
+    spectrum.anisotropy.resize(radiusCount);
+    for(int r = 0; r < radiusCount; ++r) {
+        double mean = sum[r] / count[r];
+        double variance = std::max(sumSquares[r] / count[r] - mean * mean, 0.0);
+
+        spectrum.power[r] = mean;
+        spectrum.anisotropy[r] = mean > 0.0 && variance > 0.0 ? 10.0 * std::log10(variance / (mean * mean)) : 0.0;
+    }
+
+    return spectrum;
+}
+
+double lowFrequencyEnergy(const std::vector<double> &power, int size, double cutoff) {
+    const double limit = cutoff * size / 2;
+
+    double low = 0.0;
+    double total = 0.0;
+    for(int y = 0; y < size; ++y) {
+        for(int x = 0; x < size; ++x) {
+            int fx = signedFrequency(x, size);
+            int fy = signedFrequency(y, size);
+            if(fx == 0 && fy == 0)
+                continue;
+
+            double p = power[size_t(y) * size + x];
+            if(std::sqrt(double(fx * fx + fy * fy)) < limit)
+                low += p;
+            total += p;
+        }
+    }
+
+    return total > 0.0 ? low / total : 0.0;
+}
+
+double lowFrequencyShare(int size, double cutoff) {
+    std::vector<double> white(size_t(size) * size, 1.0);
+
+    return lowFrequencyEnergy(white, size, cutoff);
+}
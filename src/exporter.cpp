@@ -0,0 +1,775 @@
+#include <exporter.hpp>
+
+#include <bluenoise.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <unordered_map>
+
+
+/// \brief Complete per pixel values with random ones for the dimensions that were not optimized, in parallel.
+/// \param settings The parameters the mask was optimized with.
+/// \param values The optimized values, count values per pixel of each frame.
+/// \param count The number of optimized values per pixel.
+/// \param exportedCount The number of values exported per pixel.
+/// \param stream The random stream of the values that were not optimized, a pixel drawing from its own blocks.
+/// \param range The values that were not optimized are drawn in [0, range), 0 for the full 32 bits.
+/// \param completed The exportedCount values of each pixel of each frame, stored row by row.
+static void completeValues(const OptimizerSettings &settings, const std::vector<GLuint> &values, int count,
+                           int exportedCount, const Philox &stream, uint32_t range, std::vector<GLuint> &completed) {
+    const int texelCount = settings.maskSize * settings.maskSize * settings.frames;
+    const int blocksPerTexel = (exportedCount + 3) / 4;
+
+    completed.resize(size_t(texelCount) * exportedCount);
+
+#pragma omp parallel for
+    for(int texel = 0; texel < texelCount; ++texel) {
+        GLuint *completedTexel = &completed[size_t(texel) * exportedCount];
+        std::copy_n(&values[size_t(texel) * count], count, completedTexel);
+
+        Philox::Block bits;
+        for(int d = count; d < exportedCount; ++d) {
+            if(d == count || d % 4 == 0)
+                bits = stream.block(uint64_t(texel) * blocksPerTexel + d / 4);
+
+            completedTexel[d] = range == 0 ? bits[d % 4] : uniformInteger(bits[d % 4], range);
+        }
+    }
+}
+
+/// \brief Complete the keys of a mask with random ones for the dimensions that were not optimized.
+/// \param settings The parameters the mask was optimized with, the random keys are drawn from settings.seed.
+/// \param scrambles The optimized scrambling values, settings.dimensions values per pixel of each frame.
+/// \param rankings The optimized ranking keys, one per pair of dimensions per pixel of each frame, or nothing.
+/// \param keys The scrambling keys, settings.totalDimensions values per pixel of each frame.
+/// \param rankingKeys The ranking keys, settings.totalDimensions / 2 values per pixel of each frame, or nothing.
+static void completeMask(const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                         const std::vector<GLuint> &rankings, std::vector<GLuint> &keys,
+                         std::vector<GLuint> &rankingKeys) {
+    completeValues(settings, scrambles, settings.dimensions, settings.totalDimensions,
+                   Philox(settings.seed, RandomPurpose::ScramblePadding), 0, keys);
+
+    rankingKeys.clear();
+    if(!rankings.empty())
+        completeValues(settings, rankings, settings.dimensions / 2, settings.totalDimensions / 2,
+                       Philox(settings.seed, RandomPurpose::RankingPadding), settings.spp, rankingKeys);
+}
+
+/// \brief Dump a table of per pixel values.
+/// \param file The file to write the table in.
+/// \param declaration The type and name of the table.
+/// \param maskSize The side of the mask.
+/// \param extent The declared size of the innermost dimension of the table.
+/// \param values The values, count values per pixel of each frame stored row by row.
+/// \param count The number of values per pixel.
+/// \param frames The number of frames, the table has no frame dimension when there is a single one.
+/// \param layout The order the pixels are stored in, a single dimension indexing the pixels along the Morton curve.
+static void writeTable(std::ofstream &file, const char *declaration, int maskSize, int extent,
+                       const std::vector<GLuint> &values, int count, int frames, bluenoise::Layout layout) {
+    const bool morton = layout == bluenoise::Layout::Morton;
+
+    file << "static const " << declaration;
+    if(frames > 1)
+        file << "[" << frames << "]";
+    if(morton)
+        file << "[" << maskSize * maskSize << "]";
+    else
+        file << "[" << maskSize << "][" << maskSize << "]";
+    file << "[" << extent << "] = {\n";
+
+    for(int frame = 0; frame < frames; ++frame) {
+        if(frames > 1)
+            file << "{\n";
+
+        // A line holds a row of the mask, or maskSize consecutive pixels of the Morton curve
+        for(int i = 0; i < maskSize; ++i) {
+            file << (morton ? "    " : "    {");
+            for(int j = 0; j < maskSize; ++j) {
+                file << "{";
+
+                uint32_t row = i;
+                uint32_t column = j;
+                if(morton)
+                    bluenoise::mortonCoordinates(i * maskSize + j, row, column);
+
+                int index = count * ((frame * maskSize + row) * maskSize + column);
+                for(int d = 0; d < count; ++d) {
+                    file << values[index + d] << 'U';
+
+                    if(d != count - 1)
+                        file << ", ";
+                }
+                file << "}";
+
+                if(j != maskSize - 1)
+                    file << ", ";
+            }
+            if(!morton)
+                file << "}";
+
+            if(i != maskSize - 1)
+                file << ",\n";
+        }
+
+        if(frames > 1)
+            file << (frame != frames - 1 ? "\n},\n" : "\n}");
+    }
+    file << "\n};\n\n\n";
+}
+
+/// \brief Export the completed keys of a mask as a header, along with its sampling function.
+/// \param filename The name of the file to export the mask in.
+/// \param settings The parameters the mask was optimized with.
+/// \param keys The scrambling keys, settings.totalDimensions values per pixel of each frame.
+/// \param rankingKeys The ranking keys, settings.totalDimensions / 2 values per pixel of each frame, or nothing.
+static void writeHeader(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &keys,
+                        const std::vector<GLuint> &rankingKeys) {
+    const int maskSize = settings.maskSize;
+    const int dimensions = settings.dimensions;
+    const int totalDimensions = settings.totalDimensions;
+    const int frames = settings.frames;
+
+    std::ofstream file;
+    file.open(filename);
+
+    char metadata[256];
+    const bool tableFree = settings.sequence == bluenoise::Sequence::SobolOwen;
+    const bool morton = settings.layout == bluenoise::Layout::Morton;
+
+    std::snprintf(metadata, sizeof(metadata), bluenoise::MetadataFormat, maskSize, frames, dimensions, totalDimensions,
+                  settings.spp, int(!rankingKeys.empty()), int(tableFree), int(morton));
+
+    file << metadata;
+    file << "#pragma once\n\n";
+    if(!tableFree)
+        file << "#include \"sobol_4096spp_256d.h\"\n";
+    if(tableFree || morton)
+        file << "#include \"bluenoise.hpp\"\n";
+    file << "\n\n";
+
+    // Dump the scrambling keys, the Morton layout only stores the dimensions used
+    writeTable(file, "uint32_t scramblingKeys", maskSize, morton ? totalDimensions : bluenoise::ScramblingKeyExtent,
+               keys, totalDimensions, frames, settings.layout);
+
+    // Dump the ranking keys, one per pair of dimensions
+    if(!rankingKeys.empty())
+        writeTable(file, "uint16_t rankingKeys", maskSize, totalDimensions / 2, rankingKeys, totalDimensions / 2,
+                   frames, settings.layout);
+
+    // Dump the sampling function, the frames wrap around like the pixels
+    std::string frame = frames > 1 ? "[frame]" : "";
+    std::string pixel = morton ? "[bluenoise::mortonIndex(i, j)]" : "[i][j]";
+    if(frames > 1) {
+        file << "float sample(int i, int j, int frame, int sampleID, int d) {\n";
+        file << "    frame = frame % " << frames << ";\n";
+    } else
+        file << "float sample(int i, int j, int sampleID, int d) {\n";
+    file << "    i = i & " << (maskSize - 1) << ";\n";
+    file << "    j = j & " << (maskSize - 1) << ";\n";
+    file << "    d = d & " << totalDimensions - 1 << ";\n\n";
+    file << "    uint32_t scramble = scramblingKeys" << frame << pixel << "[d];\n";
+    if(!rankingKeys.empty()) {
+        // The first 2^k samples of the ranked order are blue noise for every 2^k <= spp
+        file << "    sampleID = sampleID ^ rankingKeys" << frame << pixel << "[d >> 1];\n";
+    }
+    if(tableFree)
+        file << "    uint32_t sample = bluenoise::sobolOwen(sampleID, d) ^ scramble;\n\n";
+    else
+        file << "    uint32_t sample = sequence[sampleID][d] ^ scramble;\n\n";
+    file << "    return (sample + 0.5f) / " << (1ULL << 32) << "ULL;\n";
+    file << "}\n\n";
+}
+
+/// \brief Name a texture after the header of its mask, by replacing the extension of the header.
+static std::string textureName(const char *filename, const char *suffix) {
+    std::string name(filename);
+
+    size_t extension = name.find_last_of('.');
+    if(extension != std::string::npos && name.find_first_of("/\\", extension) == std::string::npos)
+        name.resize(extension);
+
+    return name + suffix;
+}
+
+void exportMaskAsHeader(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                        const std::vector<GLuint> &rankings) {
+    std::vector<GLuint> keys;
+    std::vector<GLuint> rankingKeys;
+    completeMask(settings, scrambles, rankings, keys, rankingKeys);
+
+    writeHeader(filename, settings, keys, rankingKeys);
+}
+
+void exportMask(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                const std::vector<GLuint> &rankings) {
+    std::vector<GLuint> keys;
+    std::vector<GLuint> rankingKeys;
+    completeMask(settings, scrambles, rankings, keys, rankingKeys);
+
+    writeHeader(filename, settings, keys, rankingKeys);
+
+    if(settings.textures != 0 && !exportMaskAsTextures(filename, settings, keys, rankingKeys))
+        ERROR << "Could not export the textures of " << filename << std::endl;
+
+    if(settings.swapLog && !exportSwapLog(textureName(filename, ".swaps").c_str(), settings, scrambles, rankings))
+        ERROR << "Could not export the swap log of " << filename << std::endl;
+}
+
+/// \brief Gather the values of each dimension of each frame in a layer of a texture array, in parallel.
+/// \param settings The parameters the mask was optimized with.
+/// \param values The values, count values per pixel of each frame.
+/// \param count The number of values per pixel.
+/// \return The frames * count layers, each one holding the value of every pixel row by row.
+template <typename T>
+static std::vector<T> textureLayers(const OptimizerSettings &settings, const std::vector<GLuint> &values, int count) {
+    const size_t pixelCount = size_t(settings.maskSize) * settings.maskSize;
+    const int layerCount = settings.frames * count;
+
+    std::vector<T> layers(pixelCount * layerCount);
+
+#pragma omp parallel for
+    for(int layer = 0; layer < layerCount; ++layer) {
+        const GLuint *frame = &values[(layer / count) * pixelCount * count];
+
+        for(size_t pixel = 0; pixel < pixelCount; ++pixel)
+            layers[layer * pixelCount + pixel] = T(frame[pixel * count + layer % count]);
+    }
+
+    return layers;
+}
+
+/// \brief Write a buffer in a binary file.
+static bool writeFile(const std::string &filename, const void *data, size_t size) {
+    std::ofstream file(filename, std::ios::binary);
+    file.write(static_cast<const char *>(data), size);
+
+    return bool(file);
+}
+
+/// \brief Write an uncompressed KTX2 2D texture array of unsigned integers of a single channel.
+/// \param filename The name of the texture.
+/// \param vkFormat The Vulkan format of the texels.
+/// \param typeSize The size of a texel, in bytes.
+/// \param size The side of the layers.
+/// \param layerCount The number of layers.
+/// \param data The texels of each layer, stored row by row.
+/// \return False if the file could not be written.
+static bool writeKTX2(const std::string &filename, uint32_t vkFormat, uint32_t typeSize, int size, int layerCount,
+                      const void *data) {
+    const uint32_t HeaderSize = 80;
+    const uint32_t LevelIndexSize = 24;
+    const uint32_t DescriptorSize = 44; // Total size, a basic block and a single sample
+    const uint64_t dataOffset = HeaderSize + LevelIndexSize + DescriptorSize;
+    const uint64_t dataSize = uint64_t(typeSize) * size * size * layerCount;
+
+    std::vector<uint8_t> header;
+    auto append = [&header](uint64_t value, int bytes) {
+        for(int i = 0; i < bytes; ++i)
+            header.push_back(uint8_t(value >> (8 * i)));
+    };
+
+    const uint8_t Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+    header.assign(Identifier, Identifier + 12);
+
+    append(vkFormat, 4);
+    append(typeSize, 4);
+    append(size, 4);
+    append(size, 4);
+    append(0, 4); // pixelDepth, a 2D array
+    append(layerCount, 4);
+    append(1, 4); // faceCount
+    append(1, 4); // levelCount
+    append(0, 4); // supercompressionScheme
+
+    append(HeaderSize + LevelIndexSize, 4); // dfdByteOffset
+    append(DescriptorSize, 4);
+    append(0, 4); // kvdByteOffset, no key/value data
+    append(0, 4);
+    append(0, 8); // sgdByteOffset, no supercompression global data
+    append(0, 8);
+
+    append(dataOffset, 8);
+    append(dataSize, 8);
+    append(dataSize, 8);
+
+    // Data format descriptor: a basic block in the RGBSDA color model with an unsigned integer red channel
+    append(DescriptorSize, 4);
+    append(0, 4);                        // vendorId and descriptorType
+    append(2 | (40 << 16), 4);           // versionNumber and descriptorBlockSize
+    append(1 | (1 << 8) | (1 << 16), 4); // colorModel, colorPrimaries, transferFunction and flags
+    append(0, 4);                        // texelBlockDimension
+    append(typeSize, 4);                 // bytesPlane0 to 3
+    append(0, 4);                        // bytesPlane4 to 7
+    append((8 * typeSize - 1) << 16, 4); // bitOffset, bitLength and channelType
+    append(0, 4);                        // samplePosition
+    append(0, 4);                        // sampleLower
+    append(1, 4);                        // sampleUpper, 1 as the integer formats are not normalized
+
+    std::ofstream file(filename, std::ios::binary);
+    file.write(reinterpret_cast<const char *>(header.data()), header.size());
+    file.write(static_cast<const char *>(data), dataSize);
+
+    return bool(file);
+}
+
+/// \brief Compute the CRC-32 of the chunks of a PNG image.
+static uint32_t crc32(const uint8_t *data, size_t size, uint32_t crc = 0) {
+    static const std::vector<uint32_t> table = [] {
+        std::vector<uint32_t> values(256);
+        for(uint32_t n = 0; n < 256; ++n) {
+            uint32_t c = n;
+            for(int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            values[n] = c;
+        }
+
+        return values;
+    }();
+
+    crc = ~crc;
+    for(size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+/// \brief Write a 16 bit gray and alpha PNG image. The keys are white noise to a compressor, so the image data is
+/// stored in uncompressed deflate blocks.
+/// \param filename The name of the image.
+/// \param width The width of the image.
+/// \param height The height of the image.
+/// \param gray The gray channel, stored row by row.
+/// \param alpha The alpha channel, stored row by row.
+/// \return False if the file could not be written.
+static bool writePNG(const std::string &filename, int width, int height, const uint16_t *gray, const uint16_t *alpha) {
+    // Scanlines without filtering
+    std::vector<uint8_t> scanlines;
+    scanlines.reserve(size_t(height) * (1 + 4 * width));
+    for(int y = 0; y < height; ++y) {
+        scanlines.push_back(0);
+
+        for(int x = 0; x < width; ++x) {
+            size_t pixel = size_t(y) * width + x;
+            const uint8_t samples[4] = {uint8_t(gray[pixel] >> 8), uint8_t(gray[pixel]), uint8_t(alpha[pixel] >> 8),
+                                        uint8_t(alpha[pixel])};
+            scanlines.insert(scanlines.end(), samples, samples + 4);
+        }
+    }
+
+    std::vector<uint8_t> png = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    auto append32 = [](std::vector<uint8_t> &bytes, uint32_t value) {
+        for(int i = 3; i >= 0; --i)
+            bytes.push_back(uint8_t(value >> (8 * i)));
+    };
+    auto appendChunk = [&](const char *type, const std::vector<uint8_t> &data) {
+        append32(png, (uint32_t)data.size());
+
+        size_t start = png.size();
+        png.insert(png.end(), type, type + 4);
+        png.insert(png.end(), data.begin(), data.end());
+        append32(png, crc32(&png[start], png.size() - start));
+    };
+
+    std::vector<uint8_t> ihdr;
+    append32(ihdr, width);
+    append32(ihdr, height);
+    ihdr.insert(ihdr.end(), {16, 4, 0, 0, 0}); // Bit depth, gray and alpha, deflate, no filtering, no interlacing
+    appendChunk("IHDR", ihdr);
+
+    // zlib stream of stored blocks
+    std::vector<uint8_t> idat = {0x78, 0x01};
+    const size_t BlockSize = 65535;
+    for(size_t offset = 0; offset < scanlines.size() || offset == 0; offset += BlockSize) {
+        size_t length = std::min(BlockSize, scanlines.size() - offset);
+        bool last = offset + length == scanlines.size();
+
+        idat.insert(idat.end(), {uint8_t(last), uint8_t(length), uint8_t(length >> 8), uint8_t(~length),
+                                 uint8_t(~length >> 8)});
+        idat.insert(idat.end(), scanlines.begin() + offset, scanlines.begin() + offset + length);
+    }
+
+    uint32_t a = 1, b = 0;
+    for(uint8_t byte : scanlines) {
+        a = (a + byte) % 65521;
+        b = (b + a) % 65521;
+    }
+    append32(idat, (b << 16) | a);
+
+    appendChunk("IDAT", idat);
+    appendChunk("IEND", {});
+
+    return writeFile(filename, png.data(), png.size());
+}
+
+bool exportMaskAsTextures(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &keys,
+                          const std::vector<GLuint> &rankingKeys) {
+    const int size = settings.maskSize;
+    const int pairCount = settings.totalDimensions / 2;
+    const size_t pixelCount = size_t(size) * size;
+
+    // VkFormat values of the texture arrays
+    const uint32_t R16UInt = 74;
+    const uint32_t R32UInt = 98;
+
+    bool written = true;
+
+    if(settings.textures & (TextureKTX2 | TextureRaw)) {
+        std::vector<uint32_t> layers = textureLayers<uint32_t>(settings, keys, settings.totalDimensions);
+        const int layerCount = settings.frames * settings.totalDimensions;
+
+        if(settings.textures & TextureKTX2)
+            written &= writeKTX2(textureName(filename, ".ktx2"), R32UInt, 4, size, layerCount, layers.data());
+        if(settings.textures & TextureRaw)
+            written &= writeFile(textureName(filename, ".r32ui"), layers.data(), layers.size() * sizeof(uint32_t));
+
+        if(!rankingKeys.empty()) {
+            std::vector<uint16_t> rankingLayers = textureLayers<uint16_t>(settings, rankingKeys, pairCount);
+
+            if(settings.textures & TextureKTX2)
+                written &= writeKTX2(textureName(filename, "_ranking.ktx2"), R16UInt, 2, size,
+                                     settings.frames * pairCount, rankingLayers.data());
+            if(settings.textures & TextureRaw)
+                written &= writeFile(textureName(filename, "_ranking.r16ui"), rankingLayers.data(),
+                                     rankingLayers.size() * sizeof(uint16_t));
+        }
+    }
+
+    if(settings.textures & TexturePNG) {
+        // The top bits of the keys, one layer per dimension with the frames stacked vertically
+        std::vector<uint16_t> top(pixelCount * settings.frames * settings.totalDimensions);
+
+        int failures = 0;
+
+#pragma omp parallel for reduction(+ : failures)
+        for(int pair = 0; pair < pairCount; ++pair) {
+            uint16_t *gray = &top[2 * pair * pixelCount * settings.frames];
+            uint16_t *alpha = gray + pixelCount * settings.frames;
+
+            for(size_t texel = 0; texel < pixelCount * settings.frames; ++texel) {
+                gray[texel] = uint16_t(keys[texel * settings.totalDimensions + 2 * pair] >> 16);
+                alpha[texel] = uint16_t(keys[texel * settings.totalDimensions + 2 * pair + 1] >> 16);
+            }
+
+            std::string name = textureName(filename, ("_pair" + std::to_string(pair) + ".png").c_str());
+            if(!writePNG(name, size, size * settings.frames, gray, alpha))
+                ++failures;
+        }
+
+        written &= failures == 0;
+    }
+
+    return written;
+}
+
+bool loadMaskHeader(const char *filename, OptimizerSettings &settings, std::vector<GLuint> &scrambles,
+                    std::vector<GLuint> &rankings) {
+    bluenoise::MaskData mask;
+    if(!bluenoise::loadMask(filename, mask))
+        return false;
+
+    settings.maskSize = mask.size;
+    settings.frames = mask.frames;
+    settings.dimensions = mask.dimensions;
+    settings.totalDimensions = mask.totalDimensions;
+    settings.spp = mask.spp;
+    settings.ranking = !mask.rankingKeys.empty();
+    settings.sequence = mask.sequence;
+    settings.layout = mask.layout;
+
+    scrambles.assign(mask.scramblingKeys.begin(), mask.scramblingKeys.end());
+    rankings.assign(mask.rankingKeys.begin(), mask.rankingKeys.end());
+
+    // The optimizer works on the rows of the mask
+    if(mask.layout == bluenoise::Layout::Morton) {
+        const int pixelCount = mask.size * mask.size;
+        const int pairCount = mask.totalDimensions / 2;
+
+        for(int frame = 0; frame < mask.frames; ++frame) {
+            for(int index = 0; index < pixelCount; ++index) {
+                uint32_t row, column;
+                bluenoise::mortonCoordinates(index, row, column);
+
+                size_t from = size_t(frame) * pixelCount + index;
+                size_t to = size_t(frame) * pixelCount + row * mask.size + column;
+
+                std::copy_n(&mask.scramblingKeys[from * mask.totalDimensions], mask.totalDimensions,
+                            &scrambles[to * mask.totalDimensions]);
+                if(!rankings.empty())
+                    std::copy_n(&mask.rankingKeys[from * pairCount], pairCount, &rankings[to * pairCount]);
+            }
+        }
+    }
+
+    return true;
+}
+
+static const char SwapLogMagic[4] = {'B', 'N', 'S', 'L'};
+
+/// \brief Bits needed by the values in [0, range).
+static int bitWidth(uint32_t range) {
+    int bits = 0;
+    while(bits < 32 && (uint64_t(1) << bits) < range)
+        ++bits;
+
+    return bits;
+}
+
+/// \brief Values of any width packed in a byte stream, least significant bits first.
+class BitWriter {
+public:
+    void write(uint32_t value, int bits) {
+        m_buffer |= uint64_t(value) << m_count;
+        m_count += bits;
+
+        for(; m_count >= 8; m_count -= 8, m_buffer >>= 8)
+            m_bytes.push_back(uint8_t(m_buffer));
+    }
+
+    /// \return The bytes of the stream, the last one padded with zeros.
+    const std::vector<uint8_t> &bytes() {
+        if(m_count > 0)
+            write(0U, 8 - m_count);
+
+        return m_bytes;
+    }
+
+private:
+    std::vector<uint8_t> m_bytes;
+
+    uint64_t m_buffer = 0; // Bits not written in m_bytes yet
+
+    int m_count = 0;
+};
+
+class BitReader {
+public:
+    explicit BitReader(const std::vector<uint8_t> &bytes) : m_bytes(bytes) {}
+
+    uint32_t read(int bits) {
+        // The bytes past the end read as zeros, but are counted so that a truncated stream can be detected
+        for(; m_count < bits; m_count += 8, ++m_next)
+            m_buffer |= uint64_t(m_next < m_bytes.size() ? m_bytes[m_next] : 0) << m_count;
+
+        uint32_t value = uint32_t(m_buffer & ((uint64_t(1) << bits) - 1));
+        m_buffer >>= bits;
+        m_count -= bits;
+
+        return value;
+    }
+
+    /// \brief Count the bytes the reads went through, including the ones past the end of the stream.
+    /// \return The number of bytes read.
+    size_t bytesRead() const { return m_next; }
+
+private:
+    const std::vector<uint8_t> &m_bytes;
+
+    size_t m_next = 0;
+
+    uint64_t m_buffer = 0;
+
+    int m_count = 0;
+};
+
+/// \brief Set of the sequences not placed yet, as a Fenwick tree of their counts, to find the rank of a sequence
+/// among them and the sequence of a rank in logarithmic time.
+class SequenceSet {
+public:
+    explicit SequenceSet(int count) : m_tree(count + 1, 0) {
+        for(int i = 1; i <= count; ++i) {
+            m_tree[i] += 1;
+            if(i + (i & -i) <= count)
+                m_tree[i + (i & -i)] += m_tree[i];
+        }
+
+        m_highBit = 1;
+        while(2 * m_highBit <= count)
+            m_highBit *= 2;
+    }
+
+    /// \return The number of sequences of the set below the given one.
+    int rank(int sequence) const {
+        int below = 0;
+        for(int i = sequence; i > 0; i -= i & -i)
+            below += m_tree[i];
+
+        return below;
+    }
+
+    /// \return The sequence of the set with the given rank.
+    int select(int rank) const {
+        int sequence = 0;
+        for(int step = m_highBit; step > 0; step /= 2) {
+            if(sequence + step < (int)m_tree.size() && m_tree[sequence + step] <= rank) {
+                sequence += step;
+                rank -= m_tree[sequence];
+            }
+        }
+
+        return sequence;
+    }
+
+    void remove(int sequence) {
+        for(int i = sequence + 1; i < (int)m_tree.size(); i += i & -i)
+            m_tree[i] -= 1;
+    }
+
+private:
+    std::vector<int> m_tree;
+
+    int m_highBit;
+};
+
+/// \brief The scrambles of the sequences a pair of dimensions is optimized with, as generated by the optimizer.
+static std::vector<uint64_t> seededSequences(const OptimizerSettings &settings, int pair) {
+    const int pixelCount = settings.maskSize * settings.maskSize;
+    const Philox stream(settings.seed, RandomPurpose::Scrambles, pair);
+
+    std::vector<uint64_t> sequences(pixelCount);
+
+#pragma omp parallel for
+    for(int i = 0; i < pixelCount; ++i) {
+        Philox::Block bits = stream.block(i);
+
+        sequences[i] = uint64_t(bits[0]) | uint64_t(bits[1]) << 32;
+    }
+
+    return sequences;
+}
+
+bool exportSwapLog(const char *filename, const OptimizerSettings &settings, const std::vector<GLuint> &scrambles,
+                   const std::vector<GLuint> &rankings) {
+    const int pixelCount = settings.maskSize * settings.maskSize;
+    const int pairCount = settings.dimensions / 2;
+
+    BitWriter stream;
+    for(int pair = 0; pair < pairCount; ++pair) {
+        std::vector<uint64_t> sequences = seededSequences(settings, pair);
+
+        std::unordered_map<uint64_t, int> indices(2 * pixelCount);
+        for(int i = 0; i < pixelCount; ++i)
+            indices[sequences[i]] = i;
+
+        if((int)indices.size() != pixelCount) {
+            ERROR << "Two sequences of the dimensions " << 2 * pair << " and " << 2 * pair + 1
+                  << " have the same scrambles, they cannot be told apart in a swap log" << std::endl;
+
+            return false;
+        }
+
+        // Each sequence is stored as its rank among the ones that are not placed yet, in as many bits as their count
+        for(int frame = 0; frame < settings.frames; ++frame) {
+            SequenceSet remaining(pixelCount);
+
+            for(int pixel = 0; pixel < pixelCount; ++pixel) {
+                size_t texel = size_t(frame) * pixelCount + pixel;
+                uint64_t scramble = uint64_t(scrambles[texel * settings.dimensions + 2 * pair]) |
+                                    uint64_t(scrambles[texel * settings.dimensions + 2 * pair + 1]) << 32;
+
+                auto index = indices.find(scramble);
+                if(index == indices.end() || remaining.rank(index->second + 1) == remaining.rank(index->second)) {
+                    ERROR << "The dimensions " << 2 * pair << " and " << 2 * pair + 1
+                          << " are not a permutation of the sequences of the seed " << settings.seed << std::endl;
+
+                    return false;
+                }
+
+                stream.write(remaining.rank(index->second), bitWidth(pixelCount - pixel));
+                remaining.remove(index->second);
+            }
+        }
+    }
+
+    // The ranking keys are below the sample count
+    for(GLuint key : rankings)
+        stream.write(key, bitWidth(settings.spp));
+
+    const std::vector<uint8_t> &bytes = stream.bytes();
+
+    std::ofstream file(filename, std::ios::binary);
+
+    int32_t header[10] = {settings.maskSize,        settings.dimensions, settings.totalDimensions,
+                          settings.spp,             settings.frames,     int32_t(settings.sequence),
+                          int32_t(settings.layout), settings.textures,   int32_t(!rankings.empty()),
+                          int32_t(bytes.size())};
+    file.write(SwapLogMagic, sizeof(SwapLogMagic));
+    file.write((const char *)header, sizeof(header));
+    file.write((const char *)&settings.seed, sizeof(settings.seed));
+    file.write((const char *)bytes.data(), bytes.size());
+
+    return bool(file);
+}
+
+bool loadSwapLog(const char *filename, OptimizerSettings &settings, std::vector<GLuint> &scrambles,
+                 std::vector<GLuint> &rankings) {
+    std::ifstream file(filename, std::ios::binary);
+
+    char magic[4];
+    int32_t header[10];
+    file.read(magic, sizeof(magic));
+    file.read((char *)header, sizeof(header));
+    file.read((char *)&settings.seed, sizeof(settings.seed));
+
+    if(!file || std::memcmp(magic, SwapLogMagic, sizeof(magic)) != 0)
+        return false;
+
+    // The header sizes the buffers, it is checked against the ranges the optimizer accepts
+    auto isPowerOfTwo = [](int32_t n) { return n > 0 && (n & (n - 1)) == 0; };
+    if(header[0] < 16 || !isPowerOfTwo(header[0]) || header[1] < 2 || header[1] % 2 != 0 ||
+       !isPowerOfTwo(header[2]) || header[2] < header[1] || header[2] > bluenoise::SequenceDimensions ||
+       header[3] < 1 || header[3] > bluenoise::SequenceSamples || header[4] < 1 || header[4] > 16384 / header[0] ||
+       (header[5] != 0 && header[5] != 1) || (header[6] != 0 && header[6] != 1) ||
+       (header[7] & ~(TextureKTX2 | TexturePNG | TextureRaw)) != 0 || header[9] < 0)
+        return false;
+
+    settings.maskSize = header[0];
+    settings.dimensions = header[1];
+    settings.totalDimensions = header[2];
+    settings.spp = header[3];
+    settings.frames = header[4];
+    settings.sequence = bluenoise::Sequence(header[5]);
+    settings.layout = bluenoise::Layout(header[6]);
+    settings.textures = header[7];
+    settings.ranking = header[8] != 0;
+
+    std::vector<uint8_t> bytes(header[9]);
+    file.read((char *)bytes.data(), bytes.size());
+    if(!file)
+        return false;
+
+    const int pixelCount = settings.maskSize * settings.maskSize;
+    const int pairCount = settings.dimensions / 2;
+    const size_t texelCount = size_t(pixelCount) * settings.frames;
+
+    scrambles.resize(texelCount * settings.dimensions);
+
+    BitReader stream(bytes);
+    for(int pair = 0; pair < pairCount; ++pair) {
+        std::vector<uint64_t> sequences = seededSequences(settings, pair);
+
+        for(int frame = 0; frame < settings.frames; ++frame) {
+            SequenceSet remaining(pixelCount);
+
+            for(int pixel = 0; pixel < pixelCount; ++pixel) {
+                int rank = int(stream.read(bitWidth(pixelCount - pixel)));
+                if(rank >= pixelCount - pixel)
+                    return false;
+
+                int sequence = remaining.select(rank);
+                remaining.remove(sequence);
+
+                size_t texel = size_t(frame) * pixelCount + pixel;
+                scrambles[texel * settings.dimensions + 2 * pair] = GLuint(sequences[sequence]);
+                scrambles[texel * settings.dimensions + 2 * pair + 1] = GLuint(sequences[sequence] >> 32);
+            }
+        }
+    }
+
+    rankings.assign(settings.ranking ? texelCount * pairCount : 0, 0U);
+    for(GLuint &key : rankings)
+        key = stream.read(bitWidth(settings.spp));
+
+    // Only the padding of the last byte may be left, a log of another size is truncated or corrupted
+    return stream.bytesRead() == bytes.size();
+}
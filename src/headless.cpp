@@ -0,0 +1,133 @@
+#include <headless.hpp>
+
+#ifdef HEADLESS_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+
+static EGLSurface surface = EGL_NO_SURFACE;
+
+static EGLContext context = EGL_NO_CONTEXT;
+
+/// \brief Check whether an EGL extension is supported.
+/// \param display The display, EGL_NO_DISPLAY for the client extensions.
+/// \param extension The name of the extension.
+static bool hasExtension(EGLDisplay display, const char *extension) {
+    const char *extensions = eglQueryString(display, EGL_EXTENSIONS);
+    if(!extensions)
+        return false;
+
+    size_t length = std::strlen(extension);
+    for(const char *match = std::strstr(extensions, extension); match; match = std::strstr(match + length, extension))
+        if((match == extensions || match[-1] == ' ') && (match[length] == ' ' || match[length] == '\0'))
+            return true;
+
+    return false;
+}
+
+bool createHeadlessContext() {
+    bool platformSurfaceless = false;
+    if(hasExtension(EGL_NO_DISPLAY, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+        if(getPlatformDisplay) {
+            display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            platformSurfaceless = display != EGL_NO_DISPLAY;
+        }
+    }
+
+    if(display == EGL_NO_DISPLAY)
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    EGLint major, minor;
+    if(display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor)) {
+        ERROR << "Could not initialize EGL" << std::endl;
+
+        return false;
+    }
+
+    if(!eglBindAPI(EGL_OPENGL_API)) {
+        ERROR << "EGL " << major << "." << minor << " does not support desktop OpenGL" << std::endl;
+
+        destroyHeadlessContext();
+        return false;
+    }
+
+    // Without the surfaceless extensions, the context is made current on a 1x1 pbuffer that is never drawn to
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    bool surfaceless =
+        hasExtension(display, "EGL_KHR_surfaceless_context") && hasExtension(display, "EGL_KHR_no_config_context");
+    if(!surfaceless) {
+        const EGLint ConfigAttributes[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+                                           EGL_NONE};
+        const EGLint PbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+
+        EGLint configCount = 0;
+        if(!eglChooseConfig(display, ConfigAttributes, &config, 1, &configCount) || configCount == 0 ||
+           (surface = eglCreatePbufferSurface(display, config, PbufferAttributes)) == EGL_NO_SURFACE) {
+            ERROR << "EGL supports neither surfaceless contexts nor pbuffers" << std::endl;
+
+            destroyHeadlessContext();
+            return false;
+        }
+    }
+
+    const EGLint ContextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION,
+                                        4,
+                                        EGL_CONTEXT_MINOR_VERSION,
+                                        3,
+                                        EGL_CONTEXT_OPENGL_PROFILE_MASK,
+                                        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+                                        EGL_NONE};
+
+    context = eglCreateContext(display, config, EGL_NO_CONTEXT, ContextAttributes);
+    if(context == EGL_NO_CONTEXT || !eglMakeCurrent(display, surface, surface, context)) {
+        ERROR << "Could not create an OpenGL 4.3 core context with EGL" << std::endl;
+
+        destroyHeadlessContext();
+        return false;
+    }
+
+    LOG << "Headless OpenGL context created with EGL " << major << "." << minor
+        << (platformSurfaceless ? " on the surfaceless platform" : "")
+        << (surfaceless ? " without any surface" : " on a pbuffer") << std::endl;
+
+    return true;
+}
+
+void *headlessProcAddress(const char *name) { return (void *)eglGetProcAddress(name); }
+
+void destroyHeadlessContext() {
+    if(display == EGL_NO_DISPLAY)
+        return;
+
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if(context != EGL_NO_CONTEXT)
+        eglDestroyContext(display, context);
+    if(surface != EGL_NO_SURFACE)
+        eglDestroySurface(display, surface);
+    eglTerminate(display);
+
+    display = EGL_NO_DISPLAY;
+    surface = EGL_NO_SURFACE;
+    context = EGL_NO_CONTEXT;
+}
+
+#else
+
+bool createHeadlessContext() {
+    ERROR << "The optimizer was built without EGL, the headless mode is not available" << std::endl;
+
+    return false;
+}
+
+void *headlessProcAddress(const char *) { return nullptr; }
+
+void destroyHeadlessContext() {}
+
+#endif
@@ -1,10 +1,18 @@
 #include <chrono>
 #include <thread>
 #include <iomanip>
+#include <cstring>
+#include <memory>
 
 #include <utils.hpp>
+#include <autotune.hpp>
 #include <display.hpp>
 #include <optimizer.hpp>
+#include <precomputation.hpp>
+#include <distributed.hpp>
+#include <exporter.hpp>
+#include <headless.hpp>
+#include <telemetry.hpp>
 
 #include <GLFW/glfw3.h>
 
@@ -13,94 +21,533 @@ using std::chrono::duration_cast;
 using std::chrono::milliseconds;
 using std::chrono::steady_clock;
 
-bool handleArgs(int argc, char **argv, int &spp, int &threshold);
+// Command line parameters that are not forwarded to the optimizer
+struct Arguments {
+    int threshold = 15;
+
+    std::string batchFile; // Job list of the batch mode, empty for a single optimization
+
+    std::string statsFile = PROJECT_ROOT "stats.jsonl";
+
+    std::string telemetryFile; // JSON report of the time and memory used, empty to disable the telemetry
+
+    std::string coordinatorDirectory; // Shared directory the jobs are published in, empty if not the coordinator
+
+    std::string workerDirectory; // Shared directory the pairs are claimed from, empty if not a worker
+
+    bool headless = false; // Create the OpenGL context through EGL, without any window
+
+    bool autotune = false; // Time the dispatch parameters on the device, unless they are cached for it
+
+    bool tuneSwapAttempts = false; // Also tune the swap attempts per dispatch, which changes the masks
+
+    std::string autotuneCache = PROJECT_ROOT "autotune.txt";
+};
+
+// A mask to generate
+struct Job {
+    OptimizerSettings settings;
+
+    std::string maskFile;
+};
+
+// Summary of the optimization of a mask
+struct JobStatistics {
+    int dispatchCount = 0;
+
+    uint32_t acceptedSwaps = 0;
+
+    double seconds = 0.0;
+
+    std::vector<double> energies; // Final energy of each pair of dimensions
+};
+
+bool handleArgs(int argc, char **argv, OptimizerSettings &settings, Arguments &arguments);
+
+bool readJobs(const std::string &filename, const OptimizerSettings &settings, std::vector<Job> &jobs);
+
+JobStatistics optimize(Optimizer &optimizer, const Display *display, GLFWwindow *window,
+                       const OptimizerSettings &settings, int threshold);
+
+void runJobs(const std::vector<Job> &jobs, const Arguments &arguments, GLFWwindow *window);
+
+int coordinate(const std::string &directory, const std::vector<Job> &jobs, int threshold);
+
+int waitForJobs(const std::string &directory, OptimizerSettings &settings);
+
+void work(const std::string &directory, int jobCount, const OptimizerSettings &local, const Arguments &arguments,
+          GLFWwindow *window);
+
+void writeStatistics(std::ostream &stream, const Job &job, const JobStatistics &statistics);
+
 
 int main(int argc, char **argv) {
-    // GLFW initialization
-    if(!glfwInit()) {
-        ERROR << "There was an issue during the initialization of GLFW" << std::endl;
+    OptimizerSettings settings;
+    settings.seed = std::random_device{}();
+
+    Arguments arguments;
+    if(!handleArgs(argc, argv, settings, arguments)) {
+        ERROR << "Invalid arguments, possible usages :\n"
+                 "1) ./Optimizer [Options]\n"
+                 "2) ./Optimizer SampleCount Threshold [Options]\n"
+                 "Options:\n"
+                 "    --size Size                       Side of the mask (default: 128)\n"
+                 "    --dimensions Count                Optimized dimensions (default: 16)\n"
+                 "    --total-dimensions Count          Dimensions of the sampling function, the ones that are not "
+                 "optimized are randomly scrambled (default: 64)\n"
+                 "    --proposal global|local|hybrid    Swap proposal strategy (default: global)\n"
+                 "    --tile TileSize                   Tile side of the local proposals (default: 8)\n"
+                 "    --heavisides random|stratified|sobol  How the heavisides of the distance matrix are drawn "
+                 "(default: random)\n"
+                 "    --heaviside-count Count           Heavisides of the distance matrix, a power of two (default: "
+                 "1024)\n"
+                 "    --orientation-bins Count          Orientation bins of the heavisides, the samples being sorted "
+                 "once per bin, for high sample counts (default: 0, exact orientations)\n"
+                 "    --levels Count                    Resolution levels of the coarse-to-fine optimization "
+                 "(default: 1)\n"
+                 "    --seed Seed                       Seed of the random generator (default: random)\n"
+                 "    --frames FrameCount               Frames of a spatiotemporal mask, wrapping around in time "
+                 "(default: 1)\n"
+                 "    --sequence table|sobol            Sequence the mask is optimized for: the precomputed table, or "
+                 "Owen scrambled Sobol generated on the fly (default: table)\n"
+                 "    --layout rows|morton              Order of the pixels in the exported tables, the Morton curve "
+                 "keeps the tiles of the renderer contiguous (default: rows)\n"
+                 "    --textures ktx2,png,raw           Also export the keys as a R32UI KTX2 texture array, RG16 PNG "
+                 "images of the top bits of each pair of dimensions or raw R32UI layers, next to the header\n"
+                 "    --ranking                         Also optimize the order of the samples, the mask then serves "
+                 "every power of two sample count up to SampleCount\n"
+                 "    --swap-log                        Also export the mask as a swap log of a few hundred KB, from "
+                 "which the Replayer rebuilds it\n"
+                 "    --no-display                      Skip the preview of the optimization and the pre-integration "
+                 "of its gaussian\n"
+                 "    --no-staging                      Fetch the neighbors of the candidates from the images "
+                 "instead of staging them in shared memory, faster on the CPU implementations of OpenGL\n"
+                 "    --no-neighbor-cache               Read the old energies of the candidates from the distance "
+                 "matrix instead of caching the distances of each pixel to its neighbors\n"
+                 "    --gpu-precomputation              Compute the estimates and the distance matrix with compute "
+                 "shaders instead of the CPU, the matrix never leaving the GPU\n"
+                 "    --validate-precomputation         Also compute them on the CPU and log the differences (implies "
+                 "--gpu-precomputation)\n"
+                 "    --work-group-size Size            Invocations per work group of the optimizer, a power of two "
+                 "(default: 32)\n"
+                 "    --swap-divisor Divisor            Test one pixel out of Divisor per dispatch, a power of two "
+                 "(default: 2)\n"
+                 "    --autotune                        Time short bursts of dispatches with other work group sizes "
+                 "and use the fastest one (cached per device)\n"
+                 "    --autotune-swap-divisor           Also tune the swap attempts per dispatch, which changes the "
+                 "masks (implies --autotune, ignored with --swap-divisor)\n"
+                 "    --autotune-cache CacheFile        File the tuned dispatch parameters are cached in (default: "
+                 "autotune.txt)\n"
+                 "    --headless                        Create the OpenGL context through EGL without any window, "
+                 "for the servers without a display (implies --no-display)\n"
+                 "    --batch JobFile                   Generate the masks listed in JobFile, one "
+                 "\"SampleCount Seed MaskFile\" per line\n"
+                 "    --stats StatsFile                 File the statistics of the batch jobs are written in "
+                 "(default: stats.jsonl)\n"
+                 "    --telemetry ReportFile            Write the time spent in each phase and the memory usage as "
+                 "JSON\n"
+                 "    --coordinator Directory           Publish the jobs in a shared directory and merge the pairs "
+                 "optimized by the workers\n"
+                 "    --worker Directory                Optimize the pairs of the jobs published in a shared "
+                 "directory, the other arguments are ignored\n"
+                 "Note: 1 <= SampleCount <= 4096, 1 <= Threshold, Size is a power of two of at least 16, the optimized "
+                 "dimensions are an even number below the total one, itself a power of two of at most 256, TileSize "
+                 "is a power of two in [2, Size], 1 <= Divisor <= 16 leaves a pair of pixels per tile, the coarsest "
+                 "level is at least 16x16 and 1 <= FrameCount <= 16384 / Size"
+              << std::endl;
 
-        return GLFW_INIT_ERROR;
+        return INVALID_ARGUMENTS;
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+    std::vector<Job> jobs;
+    if(arguments.batchFile.empty())
+        jobs.push_back({settings, PROJECT_ROOT "mask.h"});
+    else if(!readJobs(arguments.batchFile, settings, jobs)) {
+        ERROR << "Could not read the job list " << arguments.batchFile << std::endl;
 
-    GLFWwindow *window = glfwCreateWindow(MaskSize, MaskSize, "Optimizer", nullptr, nullptr);
+        return INVALID_ARGUMENTS;
+    }
 
-    if(!window) {
-        ERROR << "There was an issue during the initialization of the GLFW window" << std::endl;
+    // The coordinator only publishes the jobs and merges the optimized pairs, it needs no OpenGL context
+    if(!arguments.coordinatorDirectory.empty())
+        return coordinate(arguments.coordinatorDirectory, jobs, arguments.threshold);
 
-        glfwTerminate();
-        return GLFW_WINDOW_ERROR;
-    }
+    // The published jobs all share the mask size of the window
+    int jobCount = 0;
+    if(!arguments.workerDirectory.empty() && (jobCount = waitForJobs(arguments.workerDirectory, settings)) == 0)
+        return DISTRIBUTION_ERROR;
 
-    glfwMakeContextCurrent(window);
-    glfwSetWindowCloseCallback(window, [](GLFWwindow *window) { glfwSetWindowShouldClose(window, GLFW_FALSE); });
+    // The headless runs have no window, and nothing to present
+    GLFWwindow *window = nullptr;
+    if(arguments.headless) {
+        if(!createHeadlessContext())
+            return HEADLESS_CONTEXT_ERROR;
 
-    // OpenGL initialization
-    if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-        ERROR << "There was an issue loading the OpenGL function: make sure your GPU is compatible with "
-                 "OpenGL 4.3."
-              << std::endl;
+        if(!gladLoadGLLoader((GLADloadproc)headlessProcAddress)) {
+            ERROR << "There was an issue loading the OpenGL function: make sure your GPU is compatible with "
+                     "OpenGL 4.3."
+                  << std::endl;
 
-        glfwDestroyWindow(window);
-        glfwTerminate();
-        return GL_LOAD_ERROR;
+            destroyHeadlessContext();
+            return GL_LOAD_ERROR;
+        }
+    } else {
+        // GLFW initialization
+        if(!glfwInit()) {
+            ERROR << "There was an issue during the initialization of GLFW" << std::endl;
+
+            return GLFW_INIT_ERROR;
+        }
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+        glfwWindowHint(GLFW_RESIZABLE, GL_FALSE);
+
+        window = glfwCreateWindow(settings.maskSize, settings.maskSize, "Optimizer", nullptr, nullptr);
+
+        if(!window) {
+            ERROR << "There was an issue during the initialization of the GLFW window" << std::endl;
+
+            glfwTerminate();
+            return GLFW_WINDOW_ERROR;
+        }
+
+        glfwMakeContextCurrent(window);
+        glfwSetWindowCloseCallback(window, [](GLFWwindow *window) { glfwSetWindowShouldClose(window, GLFW_FALSE); });
+
+        // OpenGL initialization
+        if(!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+            ERROR << "There was an issue loading the OpenGL function: make sure your GPU is compatible with "
+                     "OpenGL 4.3."
+                  << std::endl;
+
+            glfwDestroyWindow(window);
+            glfwTerminate();
+            return GL_LOAD_ERROR;
+        }
     }
 
     // Check the GPU capabilities
     GLint64 ssboMaxSize;
     glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &ssboMaxSize);
-    if(ssboMaxSize < int(sizeof(GLfloat)) * DistanceMatrixSize) {
+    if(ssboMaxSize < GLint64(sizeof(GLfloat) * distanceMatrixSize(size_t(settings.maskSize) * settings.maskSize))) {
         ERROR << "Your OpenGL implementation only support SSBO of maximum size " << ssboMaxSize << ": aborting."
               << std::endl;
 
         return GL_SSBO_SIZE_ERROR;
     }
 
-    int spp, threshold;
-    if(!handleArgs(argc, argv, spp, threshold)) {
-        ERROR << "Invalid arguments, possible usages :\n"
-                 "1) ./Optimizer\n"
-                 "2) ./Optimizer SampleCount Threshold\n"
-                 "Note: 1 <= SampleCount <= 4096 and 1 <= Threshold"
-              << std::endl;
+    GLint maxInvocations, maxWorkGroupSize;
+    glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &maxInvocations);
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, 0, &maxWorkGroupSize);
+    maxWorkGroupSize = std::min(maxWorkGroupSize, maxInvocations);
+    if(settings.workGroupSize > maxWorkGroupSize) {
+        ERROR << "Your OpenGL implementation only supports work groups of " << maxWorkGroupSize
+              << " invocations: aborting." << std::endl;
 
         return INVALID_ARGUMENTS;
     }
 
-    Optimizer optimizer(spp);
-    Display display(optimizer.displayTexture());
+    if(!arguments.telemetryFile.empty())
+        telemetry().enable();
+
+    if(arguments.workerDirectory.empty())
+        runJobs(jobs, arguments, window);
+    else
+        work(arguments.workerDirectory, jobCount, settings, arguments, window);
+
+    if(!arguments.telemetryFile.empty() && !telemetry().write(arguments.telemetryFile))
+        WARN << "Could not write the telemetry report in " << arguments.telemetryFile << std::endl;
+
+    LOG << "Cleaning up before exiting." << std::endl;
+
+    // Cleanup
+    telemetry().freeGLRessources();
+
+    if(window) {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    } else
+        destroyHeadlessContext();
+
+    return SUCCESS;
+}
+
+void runJobs(const std::vector<Job> &jobs, const Arguments &arguments, GLFWwindow *window) {
+    std::ofstream stats;
+    if(!arguments.batchFile.empty())
+        stats.open(arguments.statsFile);
+
+    // The context, the shaders and the buffers are shared by all the jobs
+    Optimizer optimizer(jobs[0].settings);
+    std::unique_ptr<Display> display;
+    if(window)
+        display.reset(new Display(optimizer.displayTexture()));
+
+    // The parameters tuned with the first job are used by all of them
+    OptimizerSettings tuned = jobs[0].settings;
+    if(arguments.autotune)
+        autotune(optimizer, tuned, arguments.autotuneCache, arguments.tuneSwapAttempts);
+
+    telemetry().setAllocatedGpuMemory(optimizer.gpuMemoryUsage());
+
+    for(int i = 0; i < (int)jobs.size(); ++i) {
+        Job job = jobs[i];
+        job.settings.workGroupSize = tuned.workGroupSize;
+        job.settings.swapAttemptsDivisor = tuned.swapAttemptsDivisor;
+
+        // The seed is enough to reproduce the run
+        if(jobs.size() > 1)
+            LOG << "Job " << i + 1 << " out of " << jobs.size() << ": " << job.settings.spp << " spp, seed "
+                << job.settings.seed << std::endl;
+        else
+            LOG << "Seed " << job.settings.seed << std::endl;
+
+        if(i > 0)
+            optimizer.reset(job.settings);
+
+        JobStatistics statistics = optimize(optimizer, display.get(), window, job.settings, arguments.threshold);
+
+        LOG << "Exporting the mask in " << job.maskFile << std::endl;
+        optimizer.exportMask(job.maskFile.c_str());
+
+        if(stats.is_open())
+            writeStatistics(stats, job, statistics);
+    }
+
+    if(display)
+        display->freeGLRessources();
+    optimizer.freeGLRessources();
+}
+
+int coordinate(const std::string &directory, const std::vector<Job> &jobs, int threshold) {
+    for(int i = 0; i < (int)jobs.size(); ++i) {
+        if(!publishJob(directory, i, jobs[i].settings, threshold)) {
+            ERROR << "Could not publish the jobs in " << directory << std::endl;
+
+            return DISTRIBUTION_ERROR;
+        }
+    }
+
+    if(!publishJobCount(directory, (int)jobs.size())) {
+        ERROR << "Could not publish the jobs in " << directory << std::endl;
+
+        return DISTRIBUTION_ERROR;
+    }
+
+    LOG << "Published " << jobs.size() << " jobs in " << directory << ", waiting for the workers..." << std::endl;
+
+    std::vector<bool> merged(jobs.size(), false);
+    int remaining = (int)jobs.size();
+    while(remaining > 0) {
+        for(int i = 0; i < (int)jobs.size(); ++i) {
+            const OptimizerSettings &settings = jobs[i].settings;
+            const int pairCount = settings.dimensions / 2;
+
+            if(merged[i])
+                continue;
+
+            // A plane only exists once complete
+            int done = 0;
+            while(done < pairCount && std::ifstream(planeFile(directory, {i, done})))
+                ++done;
+
+            if(done < pairCount)
+                continue;
+
+            std::vector<GLuint> scrambles(settings.dimensions * settings.maskSize * settings.maskSize * settings.frames);
+            std::vector<GLuint> rankings;
+            for(int pair = 0; pair < pairCount; ++pair) {
+                if(!readPlane(planeFile(directory, {i, pair}), settings, scrambles, rankings)) {
+                    ERROR << "Could not read " << planeFile(directory, {i, pair}) << std::endl;
+
+                    return DISTRIBUTION_ERROR;
+                }
+            }
+
+            LOG << "Exporting the mask in " << jobs[i].maskFile << std::endl;
+            exportMask(jobs[i].maskFile.c_str(), settings, scrambles, rankings);
+
+            merged[i] = true;
+            --remaining;
+        }
+
+        if(remaining > 0)
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    return SUCCESS;
+}
+
+int waitForJobs(const std::string &directory, OptimizerSettings &settings) {
+    LOG << "Waiting for the jobs of " << directory << "..." << std::endl;
+
+    int jobCount;
+    while((jobCount = publishedJobCount(directory)) == 0)
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+
+    int threshold;
+    if(!readPublishedJob(directory, 0, settings, threshold)) {
+        ERROR << "Could not read the jobs of " << directory << std::endl;
+
+        return 0;
+    }
+
+    return jobCount;
+}
+
+void work(const std::string &directory, int jobCount, const OptimizerSettings &local, const Arguments &arguments,
+          GLFWwindow *window) {
+    // Created with the first claimed pair, then shared by all the pairs
+    std::unique_ptr<Optimizer> optimizer;
+    std::unique_ptr<Display> preview;
+
+    // Only the work group size is tuned, the swap attempts per dispatch are published with the jobs
+    int workGroupSize = local.workGroupSize;
+    int tunedSwapAttemptsDivisor = 0;
+
+    OptimizerSettings settings;
+    int threshold;
+    Task task;
+    while(readPublishedJob(directory, 0, settings, threshold) &&
+          claimTask(directory, jobCount, settings.dimensions / 2, task)) {
+        if(!readPublishedJob(directory, task.job, settings, threshold)) {
+            ERROR << "Could not read the job " << task.job << " of " << directory << std::endl;
+
+            break;
+        }
+        settings.pair = task.pair;
+
+        // The preview, the staging, the cache, the device of the precomputation and the work group size depend on
+        // the machine of the worker, not on the job
+        settings.display = local.display;
+        settings.staging = local.staging;
+        settings.neighborCache = local.neighborCache;
+        settings.gpuPrecomputation = local.gpuPrecomputation;
+        settings.validatePrecomputation = local.validatePrecomputation;
+        settings.workGroupSize = workGroupSize;
+
+        LOG << "Job " << task.job + 1 << " out of " << jobCount << ": dimensions " << 2 * task.pair + 1 << " and "
+            << 2 * task.pair + 2 << std::endl;
+
+        if(!optimizer) {
+            optimizer.reset(new Optimizer(settings));
+            if(window)
+                preview.reset(new Display(optimizer->displayTexture()));
+
+            telemetry().setAllocatedGpuMemory(optimizer->gpuMemoryUsage());
+        } else
+            optimizer->reset(settings);
+
+        if(arguments.autotune && settings.swapAttemptsDivisor != tunedSwapAttemptsDivisor) {
+            autotune(*optimizer, settings, arguments.autotuneCache, false);
+
+            workGroupSize = settings.workGroupSize;
+            tunedSwapAttemptsDivisor = settings.swapAttemptsDivisor;
+        }
+
+        optimize(*optimizer, preview.get(), window, settings, threshold);
+
+        if(!optimizer->exportPlane(planeFile(directory, task)))
+            ERROR << "Could not write " << planeFile(directory, task) << std::endl;
+    }
+
+    LOG << "No pair left to optimize in " << directory << std::endl;
+
+    if(optimizer) {
+        if(preview)
+            preview->freeGLRessources();
+        optimizer->freeGLRessources();
+    }
+}
+
+JobStatistics optimize(Optimizer &optimizer, const Display *display, GLFWwindow *window,
+                       const OptimizerSettings &settings, int threshold) {
+    JobStatistics statistics;
 
     int dispatchCount = 0;
     int prevAcceptedSwaps = 0;
     auto start = steady_clock::now();
 
-    while(!glfwWindowShouldClose(window)) {
+    // Convergence statistics of the current level and pair of dimensions
+    int levelDispatchCount = 0;
+    int levelFirstSwap = 0;
+    auto levelStart = steady_clock::now();
+    auto pairStart = levelStart;
+    auto optimizationStart = levelStart;
+
+    bool done = false;
+    while(!done) {
+        if(dispatchCount == 0)
+            telemetry().beginBatch();
+
+        telemetry().beginDispatch();
         optimizer.run();
+        telemetry().endDispatch();
         glFinish();
 
         if(duration_cast<milliseconds>(steady_clock::now() - start).count() > 100) {
-            display.draw();
             LOG << "Accepted permutations: " << std::setw(6) << optimizer.acceptedSwapCount() << '\r' << std::flush;
 
-            glfwSwapBuffers(window);
-            glfwPollEvents();
+            // Headless runs have no window to present nor events to poll
+            if(window) {
+                if(settings.display) {
+                    display->draw();
+                    glfwSwapBuffers(window);
+                }
+                glfwPollEvents();
+            }
 
             start = std::chrono::steady_clock::now();
         }
 
+        ++levelDispatchCount;
+        ++statistics.dispatchCount;
+
         // Check if the number of swaps for the current pair of dimension is below a threshold
         if(++dispatchCount == 100) {
             int acceptedSwaps = optimizer.acceptedSwapCount();
-
-            if(acceptedSwaps - prevAcceptedSwaps < threshold) {
-                LOG << "\n\n";
-                if(!optimizer.nextDimensions())
-                    glfwSetWindowShouldClose(window, true);
+            telemetry().endBatch(optimizer.dimension(), optimizer.level(), dispatchCount,
+                                 acceptedSwaps - prevAcceptedSwaps);
+
+            // The threshold is set for the default swap attempts per dispatch of the full resolution: the accepted
+            // swaps are scaled to them, so that every level stops at the same acceptance rate whatever the divisor,
+            // a level having 4 times fewer pixels than the next one
+            int swaps = ((acceptedSwaps - prevAcceptedSwaps) << (2 * optimizer.level())) *
+                        settings.swapAttemptsDivisor / SwapAttemptsDivisor;
+            if(swaps < threshold) {
+                if(settings.proposal == Proposal::Hybrid && !optimizer.usesLocalProposals()) {
+                    // The global proposals stalled, the local ones still find swaps for a while
+                    optimizer.useLocalProposals(true);
+                } else {
+                    int levelSwaps = acceptedSwaps - levelFirstSwap;
+                    auto now = steady_clock::now();
+                    double seconds = duration_cast<milliseconds>(now - levelStart).count() / 1000.0;
+
+                    LOG << "\n";
+                    LOG << "Converged after " << levelDispatchCount << " dispatches and " << seconds << "s: "
+                        << levelSwaps << " accepted permutations (" << double(levelSwaps) / levelDispatchCount
+                        << " per dispatch)\n";
+
+                    if(optimizer.level() == 0) {
+                        seconds = duration_cast<milliseconds>(now - pairStart).count() / 1000.0;
+                        statistics.energies.push_back(optimizer.energy());
+
+                        LOG << "Final energy " << statistics.energies.back() << " reached after " << seconds << "s\n";
+                        pairStart = now;
+                    }
+                    LOG << "\n";
+
+                    if(settings.proposal == Proposal::Hybrid)
+                        optimizer.useLocalProposals(false);
+
+                    done = !optimizer.nextDimensions();
+
+                    levelDispatchCount = 0;
+                    levelFirstSwap = acceptedSwaps;
+                    levelStart = steady_clock::now();
+                }
             }
 
             prevAcceptedSwaps = acceptedSwaps;
@@ -108,41 +555,263 @@ int main(int argc, char **argv) {
         }
     }
 
-    LOG << "Exporting the mask and cleaning up before exiting." << std::endl;
-
-    // Save the last mask
-    optimizer.exportMaskAsHeader(PROJECT_ROOT "mask.h");
-
-    // Cleanup
-    display.freeGLRessources();
-    optimizer.freeGLRessources();
-
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    statistics.acceptedSwaps = optimizer.acceptedSwapCount();
+    statistics.seconds = duration_cast<milliseconds>(steady_clock::now() - optimizationStart).count() / 1000.0;
+    LOG << "Optimization done in " << statistics.seconds << "s" << std::endl;
 
-    return SUCCESS;
+    return statistics;
 }
 
-bool handleArgs(int argc, char **argv, int &spp, int &threshold) {
-    if(argc == 1) {
-        spp = 16;
-        threshold = 15;
-    } else if(argc == 3) {
-        spp = std::atoi(argv[1]);
-        if(spp <= 0 || spp > 4096)
+bool handleArgs(int argc, char **argv, OptimizerSettings &settings, Arguments &arguments) {
+    // The optional positional arguments come before the options
+    int positionalCount = 0;
+    while(positionalCount + 1 < argc && std::strncmp(argv[positionalCount + 1], "--", 2) != 0)
+        ++positionalCount;
+
+    if(positionalCount == 0) {
+        settings.spp = 16;
+        arguments.threshold = 15;
+    } else if(positionalCount == 2) {
+        settings.spp = std::atoi(argv[1]);
+        if(settings.spp <= 0 || settings.spp > 4096)
             return false;
 
-        if(spp & (spp - 1))
+        if(settings.spp & (settings.spp - 1))
             WARN << "The sample per pixel argument should be a power of two for optimal convergence." << std::endl;
 
-        threshold = std::atoi(argv[2]);
-        if(threshold <= 0) {
+        arguments.threshold = std::atoi(argv[2]);
+        if(arguments.threshold <= 0) {
             WARN << "The provided threshold should be greater than 0. Using default threshold value (threshold = 15)."
                  << std::endl;
-            threshold = 15;
+            arguments.threshold = 15;
         }
     } else
         return false;
 
+    bool swapAttemptsSet = false;
+    for(int i = positionalCount + 1; i < argc; ++i) {
+        std::string option(argv[i]);
+
+        // Options without a value
+        if(option == "--ranking") {
+            settings.ranking = true;
+
+            continue;
+        } else if(option == "--swap-log") {
+            settings.swapLog = true;
+
+            continue;
+        } else if(option == "--no-display") {
+            settings.display = false;
+
+            continue;
+        } else if(option == "--no-staging") {
+            settings.staging = false;
+
+            continue;
+        } else if(option == "--no-neighbor-cache") {
+            settings.neighborCache = false;
+
+            continue;
+        } else if(option == "--gpu-precomputation") {
+            settings.gpuPrecomputation = true;
+
+            continue;
+        } else if(option == "--validate-precomputation") {
+            settings.gpuPrecomputation = true;
+            settings.validatePrecomputation = true;
+
+            continue;
+        } else if(option == "--autotune") {
+            arguments.autotune = true;
+
+            continue;
+        } else if(option == "--autotune-swap-divisor") {
+            arguments.autotune = true;
+            arguments.tuneSwapAttempts = true;
+
+            continue;
+        } else if(option == "--headless") {
+            arguments.headless = true;
+            settings.display = false;
+
+            continue;
+        }
+
+        if(i + 1 == argc)
+            return false;
+
+        std::string value(argv[++i]);
+
+        if(option == "--size") {
+            settings.maskSize = std::atoi(value.c_str());
+        } else if(option == "--dimensions") {
+            settings.dimensions = std::atoi(value.c_str());
+        } else if(option == "--total-dimensions") {
+            settings.totalDimensions = std::atoi(value.c_str());
+        } else if(option == "--proposal") {
+            if(value == "global")
+                settings.proposal = Proposal::Global;
+            else if(value == "local")
+                settings.proposal = Proposal::Local;
+            else if(value == "hybrid")
+                settings.proposal = Proposal::Hybrid;
+            else
+                return false;
+        } else if(option == "--heavisides") {
+            if(value == "random")
+                settings.heavisideBank = HeavisideBank::Random;
+            else if(value == "stratified")
+                settings.heavisideBank = HeavisideBank::Stratified;
+            else if(value == "sobol")
+                settings.heavisideBank = HeavisideBank::Sobol;
+            else
+                return false;
+        } else if(option == "--heaviside-count") {
+            settings.heavisideCount = std::atoi(value.c_str());
+        } else if(option == "--orientation-bins") {
+            settings.orientationBins = std::atoi(value.c_str());
+        } else if(option == "--tile") {
+            settings.tileSize = std::atoi(value.c_str());
+        } else if(option == "--levels") {
+            settings.levels = std::atoi(value.c_str());
+        } else if(option == "--frames") {
+            settings.frames = std::atoi(value.c_str());
+        } else if(option == "--sequence") {
+            if(value == "table")
+                settings.sequence = bluenoise::Sequence::Table;
+            else if(value == "sobol")
+                settings.sequence = bluenoise::Sequence::SobolOwen;
+            else
+                return false;
+        } else if(option == "--layout") {
+            if(value == "rows")
+                settings.layout = bluenoise::Layout::Rows;
+            else if(value == "morton")
+                settings.layout = bluenoise::Layout::Morton;
+            else
+                return false;
+        } else if(option == "--textures") {
+            // A comma separated list of formats
+            std::stringstream formats(value);
+            std::string format;
+            while(std::getline(formats, format, ',')) {
+                if(format == "ktx2")
+                    settings.textures |= TextureKTX2;
+                else if(format == "png")
+                    settings.textures |= TexturePNG;
+                else if(format == "raw")
+                    settings.textures |= TextureRaw;
+                else
+                    return false;
+            }
+        } else if(option == "--work-group-size") {
+            settings.workGroupSize = std::atoi(value.c_str());
+        } else if(option == "--swap-divisor") {
+            settings.swapAttemptsDivisor = std::atoi(value.c_str());
+            swapAttemptsSet = true;
+        } else if(option == "--autotune-cache") {
+            arguments.autotuneCache = value;
+        } else if(option == "--seed") {
+            settings.seed = (uint32_t)std::strtoul(value.c_str(), nullptr, 10);
+        } else if(option == "--batch") {
+            arguments.batchFile = value;
+        } else if(option == "--stats") {
+            arguments.statsFile = value;
+        } else if(option == "--telemetry") {
+            arguments.telemetryFile = value;
+        } else if(option == "--coordinator") {
+            arguments.coordinatorDirectory = value;
+        } else if(option == "--worker") {
+            arguments.workerDirectory = value;
+        } else
+            return false;
+    }
+
+    if(!arguments.coordinatorDirectory.empty() && !arguments.workerDirectory.empty())
+        return false;
+
+    // An explicit divisor is kept
+    if(swapAttemptsSet)
+        arguments.tuneSwapAttempts = false;
+
+    // The options depending on the mask size are checked once they are all known
+    auto isPowerOfTwo = [](int n) { return n > 0 && (n & (n - 1)) == 0; };
+
+    if(settings.maskSize < 16 || !isPowerOfTwo(settings.maskSize))
+        return false;
+
+    if(settings.dimensions < 2 || settings.dimensions % 2 != 0 || settings.dimensions > settings.totalDimensions)
+        return false;
+
+    // The sequence of the sampling function has 256 dimensions
+    if(settings.totalDimensions > 256 || !isPowerOfTwo(settings.totalDimensions))
+        return false;
+
+    if(settings.tileSize < 2 || settings.tileSize > settings.maskSize || !isPowerOfTwo(settings.tileSize))
+        return false;
+
+    if(settings.heavisideCount < 1 || settings.heavisideCount > 4096 || !isPowerOfTwo(settings.heavisideCount))
+        return false;
+
+    if(settings.orientationBins < 0 || settings.orientationBins > 1024)
+        return false;
+
+    if(settings.workGroupSize < 1 || settings.workGroupSize > 1024 || !isPowerOfTwo(settings.workGroupSize))
+        return false;
+
+    if(settings.swapAttemptsDivisor > 16 || !isPowerOfTwo(settings.swapAttemptsDivisor))
+        return false;
+
+    // The tiles of the local proposals need a pair of pixels at least
+    int tilePixels = settings.tileSize * settings.tileSize;
+    if(settings.proposal != Proposal::Global && tilePixels < 2 * settings.swapAttemptsDivisor)
+        return false;
+
+    if(settings.levels < 1 || (settings.maskSize >> (settings.levels - 1)) < 16)
+        return false;
+
+    // The frames are stacked vertically in textures of at most 16384 texels, the minimum GL 4.3 guarantees
+    if(settings.frames < 1 || settings.frames > 16384 / settings.maskSize)
+        return false;
+
     return true;
 }
+
+bool readJobs(const std::string &filename, const OptimizerSettings &settings, std::vector<Job> &jobs) {
+    std::ifstream file(filename);
+    if(!file)
+        return false;
+
+    std::string line;
+    while(std::getline(file, line)) {
+        // Skip the empty lines and the comments
+        if(line.find_first_not_of(" \t\r") == std::string::npos || line[line.find_first_not_of(" \t")] == '#')
+            continue;
+
+        Job job{settings, ""};
+        std::istringstream stream(line);
+        if(!(stream >> job.settings.spp >> job.settings.seed >> job.maskFile) || job.settings.spp <= 0 ||
+           job.settings.spp > 4096) {
+            ERROR << "Invalid job \"" << line << "\": expected \"SampleCount Seed MaskFile\"" << std::endl;
+
+            return false;
+        }
+
+        jobs.push_back(job);
+    }
+
+    return !jobs.empty();
+}
+
+void writeStatistics(std::ostream &stream, const Job &job, const JobStatistics &statistics) {
+    stream << "{\"mask\": \"" << job.maskFile << "\", \"spp\": " << job.settings.spp
+           << ", \"seed\": " << job.settings.seed << ", \"dispatches\": " << statistics.dispatchCount
+           << ", \"acceptedSwaps\": " << statistics.acceptedSwaps << ", \"seconds\": " << statistics.seconds
+           << ", \"energies\": [";
+
+    for(int i = 0; i < (int)statistics.energies.size(); ++i)
+        stream << (i > 0 ? ", " : "") << statistics.energies[i];
+
+    stream << "]}" << std::endl;
+}
@@ -1,65 +1,282 @@
 #include <optimizer.hpp>
-#include <sobol_4096spp_256d.h>
+#include <precomputation.hpp>
+#include <exporter.hpp>
+#include <distributed.hpp>
+#include <telemetry.hpp>
 
-#include <omp.h>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
 
 
 // Constants definition
-constexpr int HeavisideCount = 1024;
-constexpr int SwapAttemptsDivisor = 2; // Swap attempts count = Pixel count / (2 * swapAttemptsDivisor)
-constexpr int WorkGroupCount = PixelCount / (32 * 2 * SwapAttemptsDivisor);
-
-Optimizer::Optimizer(int spp)
-    : m_program(buildShaders({PROJECT_ROOT "shaders/optimizer.comp"}, {GL_COMPUTE_SHADER},
-                             {{"D", D}, {"MASK_SIZE", MaskSize}})),
-      m_scrambles(D * PixelCount), m_spp(spp) {
+// Work group sizes of the GPU precomputation: heavisides per work group of estimates.comp, and side of the tiles of the
+// distance matrix of distances.comp
+constexpr int EstimatesWorkGroupSize = 64;
+constexpr int DistanceTileSize = 16;
+
+// The pairs of the global permutation are sorted by aligned blocks of this side, so that the shader stages the sequence
+// indices around the block of each work group in shared memory (at most StageCapacity indices, 16 KB)
+constexpr int PermutationBlockSize = 16;
+constexpr int StageCapacity = 4096;
+
+// Energy parameters at full resolution, the coarse levels scale them down
+constexpr float Sigma = 2.1f;
+constexpr int Radius = 6;
+
+// Energy parameters along the time axis of the spatiotemporal masks, the radius is capped to half the frame count
+constexpr float TemporalSigma = 1.f;
+constexpr int TemporalRadius = 2;
+
+// Passes of the shader maintaining the neighbor distance cache, CACHE_FILL and CACHE_PATCH in the shader
+constexpr int CacheFill = 1;
+constexpr int CachePatch = 2;
+
+// Bursts of dispatches timed by the autotune for each set of dispatch parameters after a few untimed dispatches, the
+// fastest burst being kept
+constexpr int AutotuneWarmupDispatches = 2;
+constexpr int AutotuneBursts = 3;
+constexpr int AutotuneDispatches = 16;
+
+/// \brief Number of neighbors of a pixel in the energy window, which is the length of its row in the neighbor cache.
+/// \param radius The spatial radius of the window.
+/// \param temporalRadius The temporal radius of the window.
+/// \return The number of neighbors.
+static int neighborhoodSize(int radius, int temporalRadius) {
+    return (2 * temporalRadius + 1) * (2 * radius + 1) * (2 * radius + 1) - 1;
+}
+
+/// \brief Build the optimizer shader.
+/// \param settings The parameters of the optimization.
+/// \param workGroupSize The invocations per work group.
+/// \return The OpenGL program ID.
+static GLuint buildOptimizerProgram(const OptimizerSettings &settings, int workGroupSize) {
+    return buildShaders({PROJECT_ROOT "shaders/optimizer.comp"}, {GL_COMPUTE_SHADER},
+                        {{"D", settings.dimensions},
+                         {"MASK_SIZE", settings.maskSize},
+                         {"WORK_GROUP_SIZE", workGroupSize},
+                         {"BLOCK_SIZE", PermutationBlockSize},
+                         {"STAGE_CAPACITY", StageCapacity}});
+}
+
+Optimizer::Optimizer(const OptimizerSettings &settings)
+    : m_maskSize(settings.maskSize), m_pixelCount(settings.maskSize * settings.maskSize),
+      m_program(buildOptimizerProgram(settings, settings.workGroupSize)), m_workGroupSize(settings.workGroupSize) {
     LOG << "Initializing the optimizer..." << std::endl;
 
-    m_generator.seed(std::random_device{}());
+    reset(settings);
+}
 
+void Optimizer::reset(const OptimizerSettings &settings) {
+    m_settings = settings;
+    if(settings.workGroupSize != m_workGroupSize) {
+        glDeleteProgram(m_program);
+        m_program = buildOptimizerProgram(settings, settings.workGroupSize);
+        m_workGroupSize = settings.workGroupSize;
+    }
+
+    m_dimension = settings.pair < 0 ? 0 : 2 * settings.pair;
+    m_endDimension = settings.pair < 0 ? settings.dimensions : m_dimension + 2;
+    m_spp = settings.spp;
+    m_tileSize = settings.tileSize;
+    m_localProposals = settings.proposal == Proposal::Local;
+    m_levelCount = settings.levels;
+    m_frameCount = settings.frames;
+
+    // The prefixes of the ranked samples are only blue noise at the powers of two
+    m_ranking = settings.ranking;
+    if(m_ranking && (m_spp & (m_spp - 1))) {
+        WARN << "The ranking requires a power of two sample count, it is disabled for " << m_spp << " spp."
+             << std::endl;
+        m_ranking = false;
+    }
+    m_rankings.assign(m_ranking ? (m_settings.dimensions / 2) * m_pixelCount * m_frameCount : 0, 0U);
+    m_scrambles.resize(m_settings.dimensions * m_pixelCount * m_frameCount);
+
+    // The GPU precomputation keeps the estimates in a storage block, and only needs the host memory to be validated
+    GLint64 ssboMaxSize;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &ssboMaxSize);
+
+    GLint64 estimatesSize = GLint64(sizeof(GLfloat)) * m_pixelCount * settings.heavisideCount;
+    m_gpuPrecomputation = settings.gpuPrecomputation && estimatesSize <= ssboMaxSize;
+    if(settings.gpuPrecomputation && !m_gpuPrecomputation)
+        WARN << "The GPU precomputation needs a storage block of " << estimatesSize
+             << " bytes for the estimates, it runs on the CPU." << std::endl;
+
+    bool hostPrecomputation = !m_gpuPrecomputation || settings.validatePrecomputation;
+    m_estimates.resize(hostPrecomputation ? size_t(m_pixelCount) * settings.heavisideCount : 0);
+    m_estimates.shrink_to_fit();
+    m_distanceMatrix.resize(hostPrecomputation ? distanceMatrixSize(m_pixelCount) : 0);
+    m_distanceMatrix.shrink_to_fit();
+
+    generateEnergySSBO();
+    generateNeighborCacheSSBO();
     generatePermutationsSSBO();
     generateAtomicCounter();
     setupTextures();
 }
 
+double Optimizer::timeDispatches(int workGroupSize, int swapAttemptsDivisor) {
+    const int previousWorkGroupSize = m_workGroupSize;
+    const int previousSwapAttemptsDivisor = m_settings.swapAttemptsDivisor;
+    const int previousLevel = m_level;
+    const Philox previousGenerator = m_generator;
+
+    // The burst swaps pixels, the mask and the draws are restored afterwards so that it does not change the result
+    std::vector<GLuint> texels(4 * m_pixelCount * m_frameCount);
+    glBindTexture(GL_TEXTURE_2D, m_scramblesIn);
+    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, texels.data());
+
+    // The coarse levels are too small to tell the parameters apart
+    m_level = 0;
+    setDispatchParameters(workGroupSize, swapAttemptsDivisor);
+
+    for(int i = 0; i < AutotuneWarmupDispatches; ++i)
+        run();
+    glFinish();
+
+    GLuint query;
+    glGenQueries(1, &query);
+
+    double nanoseconds = 0.0;
+    for(int burst = 0; burst < AutotuneBursts; ++burst) {
+        glBeginQuery(GL_TIME_ELAPSED, query);
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for(int i = 0; i < AutotuneDispatches; ++i)
+            run();
+        glEndQuery(GL_TIME_ELAPSED);
+        glFinish();
+        double wall = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        GLuint64 elapsed;
+        glGetQueryObjectui64v(query, GL_QUERY_RESULT, &elapsed);
+
+        // The CPU implementations of OpenGL (e.g. Mesa llvmpipe) do not time the dispatches, their wall-clock time is
+        // the time of the device anyway
+        double burstNanoseconds = double(elapsed) < 0.01 * wall ? wall : double(elapsed);
+        if(burst == 0 || burstNanoseconds < nanoseconds)
+            nanoseconds = burstNanoseconds;
+    }
+
+    glDeleteQueries(1, &query);
+
+    m_level = previousLevel;
+    m_generator = previousGenerator;
+    uploadTexels(texels);
+    generateAtomicCounter();
+    setDispatchParameters(previousWorkGroupSize, previousSwapAttemptsDivisor);
+
+    double attempts = double(AutotuneDispatches) * m_frameCount * (m_pixelCount / (2 * swapAttemptsDivisor));
+
+    return nanoseconds / attempts;
+}
+
+void Optimizer::setDispatchParameters(int workGroupSize, int swapAttemptsDivisor) {
+    m_settings.workGroupSize = workGroupSize;
+    m_settings.swapAttemptsDivisor = swapAttemptsDivisor;
+
+    if(workGroupSize != m_workGroupSize) {
+        glDeleteProgram(m_program);
+        m_program = buildOptimizerProgram(m_settings, workGroupSize);
+        m_workGroupSize = workGroupSize;
+    }
+
+    generatePermutationsSSBO();
+    setupLevel();
+}
+
 void Optimizer::freeGLRessources() {
     glDeleteBuffers(1, &m_permutationsSSBO);
     glDeleteBuffers(1, &m_distanceMatrixSSBO);
     glDeleteBuffers(1, &m_atomicCounter);
+    glDeleteBuffers(1, &m_energySSBO);
+    glDeleteBuffers(1, &m_neighborCacheSSBO);
+    glDeleteBuffers(1, &m_estimatesSSBO);
     glDeleteTextures(1, &m_scramblesIn);
     glDeleteTextures(1, &m_scramblesOut);
     glDeleteTextures(1, &m_displayIn);
     glDeleteTextures(1, &m_displayOut);
     glDeleteProgram(m_program);
+    glDeleteProgram(m_estimatesProgram);
+    glDeleteProgram(m_distancesProgram);
 }
 
 void Optimizer::run() const {
     glUseProgram(m_program);
 
-    std::uniform_int_distribution<uint> distribution(0, MaskSize - 1);
+    std::uniform_int_distribution<uint> distribution(0, m_maskSize - 1);
     glUniform2i(glGetUniformLocation(m_program, "permutationScramble"), distribution(m_generator), distribution(m_generator));
-    glDispatchCompute(WorkGroupCount, 1, 1);
+
+    // The tile candidates are drawn by the shader itself, it only needs a new seed for each dispatch
+    glUniform1ui(glGetUniformLocation(m_program, "proposalSeed"), std::uniform_int_distribution<uint>{}(m_generator));
+
+    int size = levelSize();
+    int pairCount = size * size / (2 * m_settings.swapAttemptsDivisor);
+    int workGroupCount = (pairCount + m_workGroupSize - 1) / m_workGroupSize;
+    glDispatchCompute(workGroupCount, m_frameCount, 1);
     glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_ATOMIC_COUNTER_BARRIER_BIT);
 
-    glCopyImageSubData(m_scramblesOut, GL_TEXTURE_2D, 0, 0, 0, 0, m_scramblesIn, GL_TEXTURE_2D, 0, 0, 0, 0, MaskSize,
-                       MaskSize, 1);
-    glCopyImageSubData(m_displayOut, GL_TEXTURE_2D, 0, 0, 0, 0, m_displayIn, GL_TEXTURE_2D, 0, 0, 0, 0, MaskSize,
-                       MaskSize, 1);
+    // Same proposals again, the swapped pixels patch the cache before the output images are copied to the input ones
+    if(m_neighborCache) {
+        glUniform1i(glGetUniformLocation(m_program, "cachePass"), CachePatch);
+        glDispatchCompute(workGroupCount, m_frameCount, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1i(glGetUniformLocation(m_program, "cachePass"), 0);
+    }
+
+    glCopyImageSubData(m_scramblesOut, GL_TEXTURE_2D, 0, 0, 0, 0, m_scramblesIn, GL_TEXTURE_2D, 0, 0, 0, 0, m_maskSize,
+                       m_maskSize * m_frameCount, 1);
+    glCopyImageSubData(m_displayOut, GL_TEXTURE_2D, 0, 0, 0, 0, m_displayIn, GL_TEXTURE_2D, 0, 0, 0, 0, m_maskSize,
+                       m_maskSize * m_frameCount, 1);
 }
 
 bool Optimizer::nextDimensions() {
+    // Refine the current pair of dimensions before moving to the next one
+    if(m_level > 0) {
+        upsampleLevel();
+
+        return true;
+    }
+
     // Dump the scramble values in a buffer to export them later
-    std::vector<GLuint> scrambles(4 * PixelCount);
-    glBindTexture(GL_TEXTURE_2D, m_scramblesIn);
-    glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, scrambles.data());
+    std::vector<GLuint> scrambles(4 * m_pixelCount * m_frameCount);
+    {
+        Telemetry::Scope scope("readback");
+
+        glBindTexture(GL_TEXTURE_2D, m_scramblesIn);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, scrambles.data());
+    }
+
+    // The frames are stacked vertically, so the pixels of a frame are contiguous
+    for(int i = 0; i < m_pixelCount * m_frameCount; ++i) {
+        m_scrambles[i * m_settings.dimensions + m_dimension] = scrambles[4 * i];
+        m_scrambles[i * m_settings.dimensions + m_dimension + 1] = scrambles[4 * i + 1];
+    }
+
+    if(m_ranking) {
+        Telemetry::Scope scope("ranking");
+
+        LOG << "Optimizing the ranking keys of the dimensions " << m_dimension << " and " << m_dimension + 1 << "..."
+            << std::endl;
+
+        // Each frame is ranked on its own
+        const Philox stream(m_settings.seed, RandomPurpose::Ranking, m_dimension / 2);
+        std::vector<Heaviside> heavisides =
+            generateHeavisides(m_settings.heavisideCount, stream, m_settings.heavisideBank);
+        for(int frame = 0; frame < m_frameCount; ++frame) {
+            std::vector<GLuint> keys =
+                optimizeRanking(&scrambles[4 * m_pixelCount * frame], heavisides, sequenceTable(m_settings.sequence),
+                                m_dimension, m_spp, m_maskSize, Sigma, Radius, m_generator);
 
-    for(int i = 0; i < PixelCount; ++i) {
-        m_scrambles[i * D + m_dimension] = scrambles[4 * i];
-        m_scrambles[i * D + m_dimension + 1] = scrambles[4 * i + 1];
+            for(int i = 0; i < m_pixelCount; ++i)
+                m_rankings[(frame * m_pixelCount + i) * (m_settings.dimensions / 2) + m_dimension / 2] = keys[i];
+        }
     }
 
     m_dimension += 2;
-    if(m_dimension < D) {
+    if(m_dimension < m_endDimension) {
         setupTextures();
 
         return true;
@@ -68,6 +285,53 @@ bool Optimizer::nextDimensions() {
     return false;
 }
 
+int Optimizer::dimension() const { return m_dimension; }
+
+GLint64 Optimizer::gpuMemoryUsage() const {
+    GLint64 bytes = GLint64(sizeof(GLfloat)) * distanceMatrixSize(m_pixelCount);
+    bytes += sizeof(GLuint) * m_pixelCount / m_settings.swapAttemptsDivisor; // Permutations
+    bytes += sizeof(GLfloat) * m_pixelCount * m_frameCount;         // Energies
+    bytes += 2 * 4 * sizeof(GLuint) * m_pixelCount * m_frameCount;  // Scrambles
+    bytes += 2 * sizeof(GLfloat) * m_pixelCount * m_frameCount;     // Display
+    if(m_neighborCache)
+        bytes += GLint64(sizeof(GLfloat)) * m_pixelCount * m_frameCount *
+                 neighborhoodSize(Radius, std::min(TemporalRadius, m_frameCount / 2)); // Neighbor cache
+    if(m_gpuPrecomputation)
+        bytes += GLint64(sizeof(GLfloat)) * m_pixelCount * m_settings.heavisideCount; // Estimates
+
+    return bytes;
+}
+
+int Optimizer::level() const { return m_level; }
+
+double Optimizer::energy() const {
+    int size = levelSize();
+
+    glUseProgram(m_program);
+    glUniform1i(glGetUniformLocation(m_program, "evaluateEnergy"), GL_TRUE);
+    glDispatchCompute((size * size + m_workGroupSize - 1) / m_workGroupSize, m_frameCount, 1);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    glUniform1i(glGetUniformLocation(m_program, "evaluateEnergy"), GL_FALSE);
+
+    std::vector<GLfloat> energies(size * size * m_frameCount);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_energySSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLfloat) * energies.size(), energies.data());
+
+    double total = 0.0;
+    for(GLfloat e : energies)
+        total += e;
+
+    return total;
+}
+
+void Optimizer::useLocalProposals(bool local) {
+    m_localProposals = local;
+
+    setupLevel();
+}
+
+bool Optimizer::usesLocalProposals() const { return m_localProposals; }
+
 uint32_t Optimizer::acceptedSwapCount() const {
     GLuint swapCounter;
 
@@ -81,133 +345,309 @@ uint32_t Optimizer::acceptedSwapCount() const {
 
 GLuint Optimizer::displayTexture() const { return m_displayIn; }
 
-void Optimizer::exportMaskAsHeader(const char *filename) const {
-    std::ofstream file;
-    file.open(filename);
-
-    std::uniform_int_distribution<uint32_t> distribution;
-
-    file << "#pragma once\n\n";
-    file << "#include \"sobol_4096spp_256d.h\"\n\n\n";
-
-    // Dump the scrambling keys
-    file << "static const uint32_t scramblingKeys[" << MaskSize << "][" << MaskSize << "][" << 256 << "] = {\n";
-    for(int i = 0; i < MaskSize; ++i) {
-        file << "    {";
-        for(int j = 0; j < MaskSize; ++j) {
-            file << "{";
-
-            int index = D * (i * MaskSize + j);
-            for(int d = 0; d < D; ++d) {
-                file << m_scrambles[index + d] << 'U';
-
-                if(d != TotalD - 1)
-                    file << ", ";
-            }
+void Optimizer::exportMask(const char *filename) const {
+    Telemetry::Scope scope("export");
 
-            for(int d = D; d < TotalD; ++d) {
-                file << distribution(m_generator) << 'U';
+    ::exportMask(filename, m_settings, m_scrambles, m_rankings);
+}
 
-                if(d != TotalD - 1)
-                    file << ", ";
-            }
-            file << "}";
+bool Optimizer::exportPlane(const std::string &filename) const {
+    Telemetry::Scope scope("export");
 
-            if(j != MaskSize - 1)
-                file << ", ";
-        }
-        file << "}";
-
-        if(i != MaskSize - 1)
-            file << ",\n";
-    }
-    file << "\n};\n\n\n";
-
-    // Dump the sampling function
-    file << "float sample(int i, int j, int sampleID, int d) {\n";
-    file << "    i = i & " << (MaskSize - 1) << ";\n";
-    file << "    j = j & " << (MaskSize - 1) << ";\n";
-    file << "    d = d & " << TotalD - 1 << ";\n\n";
-    file << "    uint32_t scramble = scramblingKeys[i][j][d];\n";
-    file << "    uint32_t sample = sequence[sampleID][d] ^ scramble;\n\n";
-    file << "    return (sample + 0.5f) / " << (1ULL << 32) << "ULL;\n";
-    file << "}\n\n";
+    return writePlane(filename, m_settings, 2 * m_settings.pair, m_scrambles, m_rankings);
 }
 
 void Optimizer::generatePermutationsSSBO() {
-    const uint permutationArraySize = PixelCount / SwapAttemptsDivisor;
+    const uint pixelCount = m_pixelCount;
+    const uint permutationArraySize = pixelCount / m_settings.swapAttemptsDivisor;
 
-    std::vector<GLuint> permutations(PixelCount);
+    std::vector<GLuint> permutations(pixelCount);
+    Philox generator(m_settings.seed, RandomPurpose::Permutations);
 
-    for(uint i = 0; i < PixelCount; ++i)
+    for(uint i = 0; i < pixelCount; ++i)
         permutations[i] = i;
 
     for(uint i = 0; i < permutationArraySize; ++i) {
-        std::uniform_int_distribution<uint> distribution(i, PixelCount - 1);
+        std::uniform_int_distribution<uint> distribution(i, pixelCount - 1);
 
-        std::swap(permutations[i], permutations[distribution(m_generator)]);
+        std::swap(permutations[i], permutations[distribution(generator)]);
     }
 
-    glGenBuffers(1, &m_permutationsSSBO);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_permutationsSSBO);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * permutationArraySize, permutations.data(), GL_STATIC_DRAW);
+    // Sort the pairs by the block of their first pixel, keeping their order inside a block: the pairs never overlap, so
+    // their order does not change the result of a dispatch, but the work groups test pairs starting close to each other
+    const uint blocksPerRow = m_maskSize / PermutationBlockSize;
+    auto block = [&](const GLuint *pair) {
+        uint x = pair[0] % m_maskSize / PermutationBlockSize;
+        uint y = pair[0] / m_maskSize / PermutationBlockSize;
+
+        return y * blocksPerRow + x;
+    };
+
+    std::vector<GLuint> pairs(permutations.begin(), permutations.begin() + permutationArraySize);
+    std::vector<uint> order(permutationArraySize / 2);
+    std::iota(order.begin(), order.end(), 0U);
+    std::stable_sort(order.begin(), order.end(),
+                     [&](uint a, uint b) { return block(&pairs[2 * a]) < block(&pairs[2 * b]); });
+
+    for(uint i = 0; i < permutationArraySize / 2; ++i) {
+        permutations[2 * i] = pairs[2 * order[i]];
+        permutations[2 * i + 1] = pairs[2 * order[i] + 1];
+    }
+
+    // The buffer is kept from one mask to the next, it is only resized when the swap attempts per dispatch change
+    GLint bufferSize = 0;
+    if(m_permutationsSSBO != 0) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_permutationsSSBO);
+        glGetBufferParameteriv(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &bufferSize);
+    }
 
-    GLuint blockID = glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, "SwapData");
-    glShaderStorageBlockBinding(m_program, blockID, 0);
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_permutationsSSBO);
+    if(bufferSize != GLint(sizeof(GLuint) * permutationArraySize)) {
+        if(m_permutationsSSBO == 0)
+            glGenBuffers(1, &m_permutationsSSBO);
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_permutationsSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * permutationArraySize, permutations.data(),
+                     GL_STATIC_DRAW);
+
+        GLuint blockID = glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, "SwapData");
+        glShaderStorageBlockBinding(m_program, blockID, 0);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_permutationsSSBO);
+    } else
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLuint) * permutationArraySize, permutations.data());
 }
 
 void Optimizer::generateAtomicCounter() {
     GLuint counter = 0;
 
-    glGenBuffers(1, &m_atomicCounter);
-    glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, m_atomicCounter);
-    glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), &counter, GL_DYNAMIC_READ);
-    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 2, m_atomicCounter);
+    if(m_atomicCounter == 0) {
+        glGenBuffers(1, &m_atomicCounter);
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, m_atomicCounter);
+        glBufferData(GL_ATOMIC_COUNTER_BUFFER, sizeof(GLuint), &counter, GL_DYNAMIC_READ);
+        glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, 2, m_atomicCounter);
+    } else {
+        glBindBuffer(GL_ATOMIC_COUNTER_BUFFER, m_atomicCounter);
+        glBufferSubData(GL_ATOMIC_COUNTER_BUFFER, 0, sizeof(GLuint), &counter);
+    }
 }
 
-void Optimizer::setupTextures() {
-    LOG << "Dimensions " << m_dimension + 1 << " and " << m_dimension + 2 << " out of " << D << ":\n";
-    LOG << "Generating the scramble values... " << std::endl;
-    std::vector<GLuint> scrambles(4 * PixelCount);
+void Optimizer::generateEnergySSBO() {
+    // The frame count can change from one mask to the next
+    if(m_energySSBO == 0) {
+        glGenBuffers(1, &m_energySSBO);
 
-    std::uniform_int_distribution<GLuint> distribution;
-    for(int i = 0; i < PixelCount; ++i) {
-        scrambles[4 * i] = distribution(m_generator);
-        scrambles[4 * i + 1] = distribution(m_generator);
-        scrambles[4 * i + 2] = i;  // Index of the sequence to access the distance matrix
-        scrambles[4 * i + 3] = 0U; // Padding
+        GLuint blockID = glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, "EnergyData");
+        glShaderStorageBlockBinding(m_program, blockID, 2);
     }
 
-    LOG << "Pre-integrating the heavisides and the display gaussian..." << std::endl;
-    generateDistanceMatrix(scrambles.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_energySSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * m_pixelCount * m_frameCount, nullptr, GL_DYNAMIC_READ);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_energySSBO);
+}
+
+void Optimizer::generateNeighborCacheSSBO() {
+    // The full resolution has the most neighbors, and the frame count can change from one mask to the next
+    GLint64 size = GLint64(sizeof(GLfloat)) * m_pixelCount * m_frameCount *
+                   neighborhoodSize(Radius, std::min(TemporalRadius, m_frameCount / 2));
+
+    GLint64 ssboMaxSize;
+    glGetInteger64v(GL_MAX_SHADER_STORAGE_BLOCK_SIZE, &ssboMaxSize);
+
+    m_neighborCache = m_settings.neighborCache && size <= ssboMaxSize;
+    if(m_settings.neighborCache && !m_neighborCache)
+        WARN << "The neighbor distance cache needs a storage block of " << size << " bytes, it is disabled."
+             << std::endl;
+
+    if(!m_neighborCache) {
+        glDeleteBuffers(1, &m_neighborCacheSSBO);
+        m_neighborCacheSSBO = 0;
+
+        return;
+    }
 
-    std::vector<GLfloat> result = preintegrateDisplay(scrambles.data());
+    if(m_neighborCacheSSBO == 0) {
+        glGenBuffers(1, &m_neighborCacheSSBO);
+
+        GLuint blockID = glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, "NeighborData");
+        glShaderStorageBlockBinding(m_program, blockID, 3);
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_neighborCacheSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, size, nullptr, GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_neighborCacheSSBO);
+}
+
+int Optimizer::levelSize() const { return m_maskSize >> m_level; }
+
+void Optimizer::setupLevel() {
+    int size = levelSize();
+
+    // The global permutation only covers the full resolution mask, the coarse levels draw their pairs from a single
+    // tile covering the whole level instead
+    int tileSize = m_localProposals ? std::min(m_tileSize, size) : (m_level > 0 ? size : 0);
+    int radius = std::max((Radius + (1 << m_level) - 1) >> m_level, 1);
+    int temporalRadius = std::min(TemporalRadius, m_frameCount / 2);
+
+    glUseProgram(m_program);
+    glUniform1i(glGetUniformLocation(m_program, "maskSize"), size);
+    glUniform1i(glGetUniformLocation(m_program, "staging"), m_settings.staging);
+    glUniform1ui(glGetUniformLocation(m_program, "pairCount"), size * size / (2 * m_settings.swapAttemptsDivisor));
+    glUniform1f(glGetUniformLocation(m_program, "sigma"), Sigma / (1 << m_level));
+    glUniform1i(glGetUniformLocation(m_program, "radius"), radius);
+
+    // The frames are not downsampled by the coarse levels
+    glUniform1i(glGetUniformLocation(m_program, "frameCount"), m_frameCount);
+    glUniform1f(glGetUniformLocation(m_program, "temporalSigma"), TemporalSigma);
+    glUniform1i(glGetUniformLocation(m_program, "temporalRadius"), temporalRadius);
+
+    // Each tile is tested with as many pairs per pixel as the global permutation
+    glUniform1i(glGetUniformLocation(m_program, "tileSize"), tileSize);
+    glUniform1ui(glGetUniformLocation(m_program, "tilePairCount"),
+                 tileSize * tileSize / (2 * m_settings.swapAttemptsDivisor));
+
+    // The neighborhoods change with the level, and the images with the level and the pair of dimensions
+    glUniform1i(glGetUniformLocation(m_program, "useCache"), m_neighborCache);
+    glUniform1i(glGetUniformLocation(m_program, "neighborCount"), neighborhoodSize(radius, temporalRadius));
+    if(m_neighborCache) {
+        glUniform1i(glGetUniformLocation(m_program, "cachePass"), CacheFill);
+        glDispatchCompute((size * size + m_workGroupSize - 1) / m_workGroupSize, m_frameCount, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glUniform1i(glGetUniformLocation(m_program, "cachePass"), 0);
+    }
+}
+
+void Optimizer::upsampleLevel() {
+    int size = levelSize();
+
+    std::vector<GLuint> texels(4 * m_pixelCount * m_frameCount);
+    {
+        Telemetry::Scope scope("readback");
+
+        glBindTexture(GL_TEXTURE_2D, m_scramblesIn);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT, texels.data());
+    }
+
+    --m_level;
+    LOG << "Level " << m_level << " (" << 2 * size << "x" << 2 * size << ")" << std::endl;
+
+    // The level of side 2 * size uses the sequences [0, 4 * size * size), the first quarter being already placed
+    std::vector<GLuint> upsampled(texels);
+    std::vector<GLuint> order(3 * size * size);
+    for(int frame = 0; frame < m_frameCount; ++frame) {
+        // The new sequences are placed in order in the first frame, in a random order in the others
+        std::iota(order.begin(), order.end(), GLuint(size * size));
+        if(frame > 0)
+            std::shuffle(order.begin(), order.end(), m_generator);
+
+        const GLuint *coarse = &texels[4 * m_pixelCount * frame];
+        int sequence = 0;
+        for(int y = 0; y < 2 * size; ++y) {
+            for(int x = 0; x < 2 * size; ++x) {
+                GLuint *texel = &upsampled[4 * (m_pixelCount * frame + y * m_maskSize + x)];
+
+                if((x | y) & 1)
+                    std::memcpy(texel, &m_sequences[4 * order[sequence++]], 4 * sizeof(GLuint));
+                else
+                    std::memcpy(texel, &coarse[4 * (y / 2 * m_maskSize + x / 2)], 4 * sizeof(GLuint));
+            }
+        }
+    }
+
+    uploadTexels(upsampled);
+    setupLevel();
+}
+
+void Optimizer::uploadTexels(const std::vector<GLuint> &texels) {
+    Telemetry::Scope scope("upload");
+
+    std::vector<GLfloat> display(m_pixelCount * m_frameCount);
+    for(int i = 0; i < m_pixelCount * m_frameCount; ++i)
+        display[i] = m_sequenceDisplay[texels[4 * i + 2]];
 
     // Create the textures if they were never created
     // Else just update their content
-    if(m_dimension == 0) {
+    if(m_scramblesIn == 0) {
         m_scramblesIn =
-            generateTexture(GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 0, GL_READ_ONLY, scrambles.data());
+            generateTexture(GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 0, GL_READ_ONLY, texels.data());
         m_scramblesOut =
-            generateTexture(GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 1, GL_WRITE_ONLY, scrambles.data());
-        m_displayIn = generateTexture(GL_R32F, GL_RED, GL_FLOAT, 2, GL_READ_ONLY, result.data());
-        m_displayOut = generateTexture(GL_R32F, GL_RED, GL_FLOAT, 3, GL_WRITE_ONLY, result.data());
+            generateTexture(GL_RGBA32UI, GL_RGBA_INTEGER, GL_UNSIGNED_INT, 1, GL_READ_WRITE, texels.data());
+        m_displayIn = generateTexture(GL_R32F, GL_RED, GL_FLOAT, 2, GL_READ_ONLY, display.data());
+        m_displayOut = generateTexture(GL_R32F, GL_RED, GL_FLOAT, 3, GL_WRITE_ONLY, display.data());
     } else {
+        int height = m_maskSize * m_frameCount;
+
         glBindTexture(GL_TEXTURE_2D, m_scramblesIn);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, MaskSize, MaskSize, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
-                     scrambles.data());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, m_maskSize, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
+                     texels.data());
         glBindTexture(GL_TEXTURE_2D, m_scramblesOut);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, MaskSize, MaskSize, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
-                     scrambles.data());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32UI, m_maskSize, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_INT,
+                     texels.data());
 
         glBindTexture(GL_TEXTURE_2D, m_displayIn);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, MaskSize, MaskSize, 0, GL_RED, GL_FLOAT, result.data());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_maskSize, height, 0, GL_RED, GL_FLOAT, display.data());
         glBindTexture(GL_TEXTURE_2D, m_displayOut);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, MaskSize, MaskSize, 0, GL_RED, GL_FLOAT, result.data());
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_maskSize, height, 0, GL_RED, GL_FLOAT, display.data());
     }
 }
 
+void Optimizer::setupTextures() {
+    LOG << "Dimensions " << m_dimension + 1 << " and " << m_dimension + 2 << " out of " << m_settings.dimensions
+        << ":\n";
+    LOG << "Generating the scramble values... " << std::endl;
+    m_sequences.resize(4 * m_pixelCount);
+
+    // Every pair of dimensions has streams of its own, so it does not depend on the pairs optimized before it
+    m_generator.seed(m_settings.seed, RandomPurpose::Optimization, m_dimension / 2);
+    const Philox scrambles(m_settings.seed, RandomPurpose::Scrambles, m_dimension / 2);
+
+#pragma omp parallel for
+    for(int i = 0; i < m_pixelCount; ++i) {
+        Philox::Block bits = scrambles.block(i);
+
+        m_sequences[4 * i] = bits[0];
+        m_sequences[4 * i + 1] = bits[1];
+        m_sequences[4 * i + 2] = i;  // Index of the sequence to access the distance matrix
+        m_sequences[4 * i + 3] = 0U; // Padding
+    }
+
+    LOG << "Pre-integrating the heavisides" << (m_settings.display ? " and the display gaussian..." : "...")
+        << std::endl;
+    generateDistanceMatrix(m_sequences.data());
+
+    // Without a preview, the display textures are only swapped along with the scrambles
+    if(m_settings.display) {
+        Telemetry::Scope scope("displayPreintegration");
+
+        m_sequenceDisplay = preintegrateDisplay(m_sequences.data(), sequenceTable(m_settings.sequence), m_dimension,
+                                                m_spp, m_pixelCount);
+    } else
+        m_sequenceDisplay.assign(m_pixelCount, 0.5f);
+
+    // The coarsest level uses the first sequences, the pixels outside of it are not read until the full resolution
+    m_level = m_levelCount - 1;
+    int size = levelSize();
+    if(m_levelCount > 1)
+        LOG << "Level " << m_level << " (" << size << "x" << size << ")" << std::endl;
+
+    // Every frame starts from the same sequences, in order in the first frame and in a random order in the others
+    std::vector<GLuint> texels(4 * m_pixelCount * m_frameCount);
+    std::vector<GLuint> order(size * size);
+    for(int frame = 0; frame < m_frameCount; ++frame) {
+        std::iota(order.begin(), order.end(), 0U);
+        if(frame > 0)
+            std::shuffle(order.begin(), order.end(), m_generator);
+
+        GLuint *frameTexels = &texels[4 * m_pixelCount * frame];
+        std::memcpy(frameTexels, m_sequences.data(), 4 * sizeof(GLuint) * m_pixelCount);
+        for(int y = 0; y < size; ++y)
+            for(int x = 0; x < size; ++x)
+                std::memcpy(&frameTexels[4 * (y * m_maskSize + x)], &m_sequences[4 * order[y * size + x]],
+                            4 * sizeof(GLuint));
+    }
+
+    uploadTexels(texels);
+    setupLevel();
+}
+
 GLuint Optimizer::generateTexture(GLenum internal_format, GLenum format, GLenum data_type, int image_unit,
                                   GLenum access, const void *data) const {
     GLuint texture;
@@ -218,133 +658,169 @@ GLuint Optimizer::generateTexture(GLenum internal_format, GLenum format, GLenum
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, MaskSize, MaskSize, 0, format, data_type, data);
+    glTexImage2D(GL_TEXTURE_2D, 0, internal_format, m_maskSize, m_maskSize * m_frameCount, 0, format, data_type, data);
 
     glBindImageTexture(image_unit, texture, 0, GL_FALSE, 0, access, internal_format);
 
     return texture;
 }
 
-GLfloat squaredL2Norm(GLfloat *v1, GLfloat *v2, int dimension) {
-    GLfloat l2sq = 0.f;
+void Optimizer::generateDistanceMatrix(GLuint *scrambles) {
+    std::vector<Heaviside> heavisides;
+    {
+        Telemetry::Scope scope("heavisides");
 
-    for(int i = 0; i < dimension; ++i) {
-        GLfloat diff = v1[i] - v2[i];
-        l2sq += diff * diff;
+        const Philox stream(m_settings.seed, RandomPurpose::Heavisides, m_dimension / 2);
+        heavisides = generateHeavisides(m_settings.heavisideCount, stream, m_settings.heavisideBank);
     }
 
-    return l2sq;
-}
-
-void Optimizer::generateDistanceMatrix(GLuint *scrambles) {
-    std::uniform_real_distribution<GLfloat> distribution;
+    // Generate the buffer if it is was not initialized before, the GPU precomputation writes it directly
+    if(m_distanceMatrixSSBO == 0) {
+        glGenBuffers(1, &m_distanceMatrixSSBO);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_distanceMatrixSSBO);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * distanceMatrixSize(m_pixelCount), nullptr,
+                     GL_STATIC_DRAW);
 
-    // A rotation vector + a point
-    std::vector<Heaviside> heavisides(HeavisideCount);
+        GLuint blockID = glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, "DistanceData");
+        glShaderStorageBlockBinding(m_program, blockID, 1);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_distanceMatrixSSBO);
+    }
 
-    const float PI = 3.14159265359f;
-    for(int i = 0; i < HeavisideCount; ++i) {
-        float theta = 2 * PI * distribution(m_generator);
+    if(m_gpuPrecomputation) {
+        computeDistanceMatrixGPU(scrambles, heavisides);
 
-        heavisides[i].nx = std::cos(theta);
-        heavisides[i].ny = std::sin(theta);
-        heavisides[i].px = distribution(m_generator);
-        heavisides[i].py = distribution(m_generator);
+        if(!m_settings.validatePrecomputation)
+            return;
     }
 
-    std::vector<float> estimates(PixelCount * HeavisideCount);
-    std::vector<GLfloat> distanceMatrix(DistanceMatrixSize);
-
-#pragma omp parallel
     {
-#pragma omp for
-        for(int i = 0; i < PixelCount; ++i) {
-            int scrambleIndex = 4 * i;
+        Telemetry::Scope scope("estimates");
 
-            for(int j = 0; j < HeavisideCount; ++j) {
-                int index = i * HeavisideCount + j;
-                estimates[index] = integrateHeaviside(&scrambles[scrambleIndex], heavisides[j]);
-            }
-        }
+        // The GPU integrates the exact orientations, so does the CPU when it validates it
+        computeEstimates(scrambles, heavisides, sequenceTable(m_settings.sequence), m_dimension, m_spp, m_pixelCount,
+                         m_estimates, m_gpuPrecomputation ? 0 : m_settings.orientationBins);
+    }
 
+    {
+        Telemetry::Scope scope("distanceMatrix");
 
-#pragma omp for schedule(dynamic)
-        for(int i = 0; i < PixelCount; ++i) {
-            for(int j = i; j < PixelCount; ++j) {
-                GLuint offset_i = i * HeavisideCount;
-                GLuint offset_j = j * HeavisideCount;
-                GLfloat distance =
-                    squaredL2Norm(estimates.data() + offset_i, estimates.data() + offset_j, HeavisideCount);
+        computeDistanceMatrix(m_estimates, m_settings.heavisideCount, m_maskSize, m_distanceMatrix);
+    }
 
-                GLuint index = j + i * PixelCount - i * (i + 1) / 2;
+    if(m_gpuPrecomputation) {
+        validateDistanceMatrix();
 
-                distanceMatrix[index] = distance; 
-            }
-        }
+        return;
     }
 
-    // Generate the buffer if it is was not initialized before
-    if(m_dimension == 0) {
-        glGenBuffers(1, &m_distanceMatrixSSBO);
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_distanceMatrixSSBO);
-        glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLfloat) * DistanceMatrixSize, distanceMatrix.data(),
-                     GL_STATIC_DRAW);
+    Telemetry::Scope scope("upload");
 
-        GLuint blockID = glGetProgramResourceIndex(m_program, GL_SHADER_STORAGE_BLOCK, "DistanceData");
-        glShaderStorageBlockBinding(m_program, blockID, 1);
-        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_distanceMatrixSSBO);
-    } else {
-        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_distanceMatrixSSBO);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_distanceMatrixSSBO);
 
-        GLfloat *buffer = (GLfloat *)glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_WRITE_ONLY);
-        std::memcpy(buffer, distanceMatrix.data(), sizeof(GLfloat) * DistanceMatrixSize);
+    GLfloat *buffer = (GLfloat *)glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_WRITE_ONLY);
+    std::memcpy(buffer, m_distanceMatrix.data(), sizeof(GLfloat) * m_distanceMatrix.size());
 
-        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    }
+    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
 }
 
-std::vector<GLfloat> Optimizer::preintegrateDisplay(GLuint *scrambling) const {
-    std::vector<GLfloat> result(PixelCount);
+void Optimizer::computeDistanceMatrixGPU(const GLuint *scrambles, const std::vector<Heaviside> &heavisides) {
+    const int heavisideCount = (int)heavisides.size();
 
-    double variance = 0.0;
-    float Div = 1.f / (1ULL << 32);
-    for(int i = 0; i < PixelCount; ++i) {
-        double sum = 0.0;
+    // Built on first use, so that the optimizations precomputing on the CPU never compile them
+    if(m_estimatesProgram == 0) {
+        m_estimatesProgram = buildShaders({PROJECT_ROOT "shaders/estimates.comp"}, {GL_COMPUTE_SHADER}, {});
+        m_distancesProgram = buildShaders({PROJECT_ROOT "shaders/distances.comp"}, {GL_COMPUTE_SHADER},
+                                          {{"PIXEL_COUNT", m_pixelCount}});
+    }
 
-        for(int j = 0; j < m_spp; ++j) {
-            float x = ((sequence[j][m_dimension] ^ scrambling[4 * i]) + 0.5f) * Div;
-            float y = ((sequence[j][m_dimension + 1] ^ scrambling[4 * i + 1]) + 0.5f) * Div;
-            sum += std::exp(-x * x - y * y);
-        }
+    // Only the pair of dimensions of the first spp samples is uploaded, not the whole table
+    SequenceTable table = sequenceTable(m_settings.sequence);
+    std::vector<GLuint> samples(2 * m_spp);
+    for(int k = 0; k < m_spp; ++k) {
+        samples[2 * k] = table[k][m_dimension];
+        samples[2 * k + 1] = table[k][m_dimension + 1];
+    }
+
+    // The inputs only live for the precomputation, the estimates buffer is kept from one pair of dimensions to the next
+    GLuint inputs[3];
+    const void *data[3] = {samples.data(), scrambles, heavisides.data()};
+    const GLsizeiptr sizes[3] = {GLsizeiptr(sizeof(GLuint) * samples.size()),
+                                 GLsizeiptr(4 * sizeof(GLuint) * m_pixelCount),
+                                 GLsizeiptr(sizeof(Heaviside) * heavisideCount)};
+
+    glGenBuffers(3, inputs);
+    for(int b = 0; b < 3; ++b) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, inputs[b]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, sizes[b], data[b], GL_STATIC_DRAW);
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 4 + b, inputs[b]);
+    }
+
+    if(m_estimatesSSBO == 0)
+        glGenBuffers(1, &m_estimatesSSBO);
 
-        result[i] = float(sum / m_spp - 0.5577462854);
-        variance += double(result[i] * result[i]);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_estimatesSSBO);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, GLsizeiptr(sizeof(GLfloat)) * m_pixelCount * heavisideCount, nullptr,
+                 GL_DYNAMIC_COPY);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 7, m_estimatesSSBO);
+
+    // The dispatches are waited for, so that the telemetry times them rather than their submission
+    {
+        Telemetry::Scope scope("estimates");
+
+        glUseProgram(m_estimatesProgram);
+        glUniform1i(glGetUniformLocation(m_estimatesProgram, "maskSize"), m_maskSize);
+        glUniform1i(glGetUniformLocation(m_estimatesProgram, "spp"), m_spp);
+        glUniform1i(glGetUniformLocation(m_estimatesProgram, "heavisideCount"), heavisideCount);
+
+        glDispatchCompute((heavisideCount + EstimatesWorkGroupSize - 1) / EstimatesWorkGroupSize, m_maskSize,
+                          m_maskSize);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glFinish();
     }
-    variance /= PixelCount;
-    float stddev = float(std::sqrt(variance));
 
-    // Set the standard deviation to 1/4
-    for(int i = 0; i < PixelCount; ++i)
-        result[i] = result[i] / (4 * stddev) + 0.5f;
+    {
+        Telemetry::Scope scope("distanceMatrix");
+
+        glUseProgram(m_distancesProgram);
+        glUniform1i(glGetUniformLocation(m_distancesProgram, "heavisideCount"), heavisideCount);
+
+        // The tiles of the upper triangle, two rows of tiles per row of work groups
+        int tileCount = m_pixelCount / DistanceTileSize;
+        glDispatchCompute(tileCount + 1, tileCount / 2, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+        glFinish();
+    }
 
-    return result;
+    glDeleteBuffers(3, inputs);
 }
 
-float Optimizer::integrateHeaviside(GLuint scramble[2], const Heaviside &heaviside) const {
-    const float SampleWeight = 1.f / m_spp;
-    const float Div = 1.f / (1ULL << 32);
+void Optimizer::validateDistanceMatrix() {
+    Telemetry::Scope scope("validation");
 
-    double sum = 0.f;
-    for(int k = 0; k < m_spp; ++k) {
-        double sample[2] = {((sequence[k][m_dimension] ^ scramble[0]) + 0.5) * Div,
-                            ((sequence[k][m_dimension + 1] ^ scramble[1]) + 0.5) * Div};
+    std::vector<float> estimates(m_estimates.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_estimatesSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * estimates.size(), estimates.data());
+
+    std::vector<GLfloat> distanceMatrix(m_distanceMatrix.size());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_distanceMatrixSSBO);
+    glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(GLfloat) * distanceMatrix.size(), distanceMatrix.data());
 
-        double v[2] = {sample[0] - heaviside.px, sample[1] - heaviside.py};
+    size_t differentEstimates = 0;
+    for(size_t i = 0; i < estimates.size(); ++i)
+        differentEstimates += estimates[i] != m_estimates[i];
 
-        double eval = (v[0] * heaviside.nx + v[1] * heaviside.ny < 0.f ? 1.f : 0.f);
+    // The sums of the distances are not done in the same order, the errors are relative to the mean distance
+    double mean = 0.0, squaredError = 0.0, maxError = 0.0;
+    for(size_t i = 0; i < distanceMatrix.size(); ++i) {
+        double error = std::abs(double(distanceMatrix[i]) - double(m_distanceMatrix[i]));
 
-        sum += eval;
+        mean += m_distanceMatrix[i];
+        squaredError += error * error;
+        maxError = std::max(maxError, error);
     }
+    mean /= distanceMatrix.size();
 
-    return float(sum * SampleWeight);
+    LOG << "GPU precomputation: " << differentEstimates << " estimates out of " << estimates.size()
+        << " differ from the CPU ones, distance error RMS " << std::sqrt(squaredError / distanceMatrix.size()) / mean
+        << " and max " << maxError / mean << " relative to the mean distance" << std::endl;
 }
@@ -0,0 +1,592 @@
+#include <precomputation.hpp>
+#include <sobol_4096spp_256d.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <omp.h>
+
+
+// The distance matrix and the energy kernels are instantiated for the common mask sizes and for the full resolution
+// radius, so that the compiler unrolls and vectorizes the loops with their bounds known at compile time. The
+// instantiation with 0 sizes is the generic fallback, reading them at runtime.
+
+template <int StaticDimension>
+static inline GLfloat squaredL2NormKernel(const GLfloat *v1, const GLfloat *v2, int dimension) {
+    const int n = StaticDimension ? StaticDimension : dimension;
+
+    GLfloat l2sq = 0.f;
+    for(int i = 0; i < n; ++i) {
+        GLfloat diff = v1[i] - v2[i];
+        l2sq += diff * diff;
+    }
+
+    return l2sq;
+}
+
+template <int StaticMaskSize, int StaticHeavisideCount>
+static void computeDistanceMatrixKernel(const float *estimates, int heavisideCount, int maskSize,
+                                        GLfloat *distanceMatrix) {
+    const int pixelCount = StaticMaskSize ? StaticMaskSize * StaticMaskSize : maskSize * maskSize;
+    const int n = StaticHeavisideCount ? StaticHeavisideCount : heavisideCount;
+
+#pragma omp parallel for schedule(dynamic)
+    for(int i = 0; i < pixelCount; ++i) {
+        for(int j = i; j < pixelCount; ++j) {
+            size_t offset_i = size_t(i) * n;
+            size_t offset_j = size_t(j) * n;
+            GLfloat distance = squaredL2NormKernel<StaticHeavisideCount>(estimates + offset_i, estimates + offset_j, n);
+
+            distanceMatrix[distanceIndex(i, j, pixelCount)] = distance;
+        }
+    }
+}
+
+template <int StaticMaskSize, int StaticRadius>
+static double maskEnergyKernel(const GLuint *texels, const GLfloat *distanceMatrix, int maskSize, int size,
+                               float sigma, int radius) {
+    const int stride = StaticMaskSize ? StaticMaskSize : maskSize;
+    const int r = StaticRadius ? StaticRadius : radius;
+    const float sigma_i2 = sigma * sigma;
+
+    double total = 0.0;
+
+#pragma omp parallel for reduction(+ : total) schedule(dynamic)
+    for(int y = 0; y < size; ++y) {
+        for(int x = 0; x < size; ++x) {
+            GLuint center = texels[4 * (y * stride + x) + 2];
+
+            float energy = 0.f;
+            for(int i = x - r; i <= x + r; ++i) {
+                for(int j = y - r; j <= y + r; ++j) {
+                    if(i == x && j == y)
+                        continue;
+
+                    // Circular distance to the center, as in the shader
+                    int dx = std::abs(i - x);
+                    int dy = std::abs(j - y);
+                    dx = std::min(dx, size - dx);
+                    dy = std::min(dy, size - dy);
+
+                    int px = (i + size) % size;
+                    int py = (j + size) % size;
+                    GLuint neighbor = texels[4 * (py * stride + px) + 2];
+
+                    size_t index = center < neighbor ? distanceIndex(center, neighbor, stride * stride)
+                                                     : distanceIndex(neighbor, center, stride * stride);
+
+                    energy += std::exp(-(dx * dx + dy * dy) / sigma_i2) * distanceMatrix[index];
+                }
+            }
+
+            total += energy;
+        }
+    }
+
+    return total;
+}
+
+/// \brief Compute exp(x) with a polynomial, so that the loops calling it are vectorized.
+/// \param x The exponent, in (-87, 0].
+/// \return exp(x), with a relative error below 2e-7.
+static inline float exponential(float x) {
+    const float Log2e = 1.44269504f;
+    const float Ln2 = 0.693147181f;
+
+    // exp(x) = 2^n exp(r) with n the nearest integer to x / ln(2), so that |r| <= ln(2) / 2
+    int n = int(x * Log2e - 0.5f);
+    float r = x - n * Ln2;
+
+    float p = 1.f + r * (1.f + r * (1.f / 2 + r * (1.f / 6 + r * (1.f / 24 + r * (1.f / 120 + r * (1.f / 720))))));
+
+    int32_t bits = (n + 127) << 23;
+    float scale;
+    std::memcpy(&scale, &bits, sizeof(float));
+
+    return p * scale;
+}
+
+using DistanceMatrixKernel = void (*)(const float *, int, int, GLfloat *);
+using MaskEnergyKernel = double (*)(const GLuint *, const GLfloat *, int, int, float, int);
+
+struct DistanceMatrixKernelEntry {
+    int maskSize;
+
+    int heavisideCount;
+
+    DistanceMatrixKernel kernel;
+};
+
+struct MaskEnergyKernelEntry {
+    int maskSize;
+
+    int radius;
+
+    MaskEnergyKernel kernel;
+};
+
+// The default count, and the smaller banks the stratified and Sobol heavisides allow
+static const DistanceMatrixKernelEntry DistanceMatrixKernels[] = {
+    {64, HeavisideCount, &computeDistanceMatrixKernel<64, HeavisideCount>},
+    {128, HeavisideCount, &computeDistanceMatrixKernel<128, HeavisideCount>},
+    {256, HeavisideCount, &computeDistanceMatrixKernel<256, HeavisideCount>},
+    {64, 256, &computeDistanceMatrixKernel<64, 256>},
+    {128, 256, &computeDistanceMatrixKernel<128, 256>},
+    {256, 256, &computeDistanceMatrixKernel<256, 256>},
+    {64, 512, &computeDistanceMatrixKernel<64, 512>},
+    {128, 512, &computeDistanceMatrixKernel<128, 512>},
+    {256, 512, &computeDistanceMatrixKernel<256, 512>}};
+
+static const MaskEnergyKernelEntry MaskEnergyKernels[] = {
+    {64, 6, &maskEnergyKernel<64, 6>}, {128, 6, &maskEnergyKernel<128, 6>}, {256, 6, &maskEnergyKernel<256, 6>}};
+
+
+SequenceTable sequenceTable(bluenoise::Sequence kind) {
+    if(kind == bluenoise::Sequence::Table)
+        return sequence;
+
+    // Generated once, the initialization of a static being thread safe
+    static const std::vector<GLuint> samples = [] {
+        std::vector<GLuint> samples(size_t(bluenoise::SequenceSamples) * bluenoise::SequenceDimensions);
+
+#pragma omp parallel for
+        for(int k = 0; k < bluenoise::SequenceSamples; ++k)
+            for(int d = 0; d < bluenoise::SequenceDimensions; ++d)
+                samples[size_t(k) * bluenoise::SequenceDimensions + d] = bluenoise::sobolOwen(k, d);
+
+        return samples;
+    }();
+
+    return reinterpret_cast<SequenceTable>(samples.data());
+}
+
+/// \brief Nested uniform scramble of a 32 bit fixed point number, with the hash based permutation of Laine and Karras
+/// improved by Burley.
+static inline uint32_t owenScramble(uint32_t x, uint32_t seed) {
+    x = bluenoise::reverseBits(x);
+    x += seed;
+    x ^= x * 0x6C50B47CU;
+    x ^= x * 0xB82F1E52U;
+    x ^= x * 0xC7AFE638U;
+    x ^= x * 0x8D22F6E6U;
+
+    return bluenoise::reverseBits(x);
+}
+
+/// \brief Generate a sample of the first three dimensions of the Sobol sequence.
+/// \param index The index of the sample.
+/// \param sample The sample, as 32 bit fixed point numbers.
+static void sobolSample(uint32_t index, uint32_t sample[3]) {
+    // Primitive polynomials 1, x + 1 and x^2 + x + 1, with the initial direction numbers 1 and (1, 3) of Joe and Kuo
+    static const std::array<std::array<uint32_t, 32>, 3> Directions = [] {
+        std::array<std::array<uint32_t, 32>, 3> directions;
+
+        uint32_t m1 = 1, m2[2] = {1, 3};
+        for(int k = 0; k < 32; ++k) {
+            if(k > 0)
+                m1 ^= m1 << 1;
+            uint32_t m = k < 2 ? m2[k] : (m2[1] << 1) ^ (m2[0] << 2) ^ m2[0];
+            if(k >= 2) {
+                m2[0] = m2[1];
+                m2[1] = m;
+            }
+
+            directions[0][k] = 1U << (31 - k);
+            directions[1][k] = m1 << (31 - k);
+            directions[2][k] = m << (31 - k);
+        }
+
+        return directions;
+    }();
+
+    sample[0] = sample[1] = sample[2] = 0;
+    for(int k = 0; index; ++k, index >>= 1) {
+        if(index & 1) {
+            sample[0] ^= Directions[0][k];
+            sample[1] ^= Directions[1][k];
+            sample[2] ^= Directions[2][k];
+        }
+    }
+}
+
+std::vector<Heaviside> generateHeavisides(int count, const Philox &stream, HeavisideBank bank) {
+    // A rotation vector + a point
+    std::vector<Heaviside> heavisides(count);
+
+    const float PI = 3.14159265359f;
+
+    // The Latin hypercube strata of the points, ranks of random keys
+    std::vector<int> strataX, strataY;
+    if(bank == HeavisideBank::Stratified) {
+        std::vector<uint32_t> keysX(count), keysY(count);
+        for(int i = 0; i < count; ++i) {
+            keysX[i] = stream.block(i)[3];
+            keysY[i] = stream.block(count + i)[0];
+        }
+
+        for(auto strata : {std::make_pair(&strataX, &keysX), std::make_pair(&strataY, &keysY)}) {
+            const std::vector<uint32_t> &keys = *strata.second;
+            std::vector<int> order(count);
+            std::iota(order.begin(), order.end(), 0);
+            std::sort(order.begin(), order.end(), [&](int a, int b) { return keys[a] < keys[b]; });
+
+            strata.first->resize(count);
+            for(int rank = 0; rank < count; ++rank)
+                (*strata.first)[order[rank]] = rank;
+        }
+    }
+
+    // A digital scramble of the whole Sobol bank, one seed per dimension
+    const Philox::Block seeds = stream.block(0);
+
+#pragma omp parallel for
+    for(int i = 0; i < count; ++i) {
+        float u[3];
+        if(bank == HeavisideBank::Random) {
+            Philox::Block bits = stream.block(i);
+
+            u[0] = uniformFloat(bits[0]);
+            u[1] = uniformFloat(bits[1]);
+            u[2] = uniformFloat(bits[2]);
+        } else if(bank == HeavisideBank::Stratified) {
+            // One orientation per stratum, the points jittered in their Latin hypercube cell
+            Philox::Block bits = stream.block(i);
+
+            u[0] = (i + uniformFloat(bits[0])) / count;
+            u[1] = (strataX[i] + uniformFloat(bits[1])) / count;
+            u[2] = (strataY[i] + uniformFloat(bits[2])) / count;
+        } else {
+            uint32_t sample[3];
+            sobolSample(uint32_t(i), sample);
+
+            for(int d = 0; d < 3; ++d)
+                u[d] = uniformFloat(owenScramble(sample[d], seeds[d]));
+        }
+
+        float theta = 2 * PI * u[0];
+
+        heavisides[i].nx = std::cos(theta);
+        heavisides[i].ny = std::sin(theta);
+        heavisides[i].px = u[1];
+        heavisides[i].py = u[2];
+    }
+
+    return heavisides;
+}
+
+float integrateHeaviside(const GLuint scramble[2], const Heaviside &heaviside, SequenceTable table, int dimension,
+                         int spp, int firstSample) {
+    const float SampleWeight = 1.f / spp;
+    const float Div = 1.f / (1ULL << 32);
+
+    double sum = 0.f;
+    for(int k = firstSample; k < firstSample + spp; ++k) {
+        double sample[2] = {((table[k][dimension] ^ scramble[0]) + 0.5) * Div,
+                            ((table[k][dimension + 1] ^ scramble[1]) + 0.5) * Div};
+
+        double v[2] = {sample[0] - heaviside.px, sample[1] - heaviside.py};
+
+        double eval = (v[0] * heaviside.nx + v[1] * heaviside.ny < 0.f ? 1.f : 0.f);
+
+        sum += eval;
+    }
+
+    return float(sum * SampleWeight);
+}
+
+GLfloat squaredL2Norm(const GLfloat *v1, const GLfloat *v2, int dimension) {
+    return squaredL2NormKernel<0>(v1, v2, dimension);
+}
+
+/// \brief The heavisides whose orientation is snapped to the same bin, sorted by threshold.
+struct OrientationBin {
+    float nx, ny; // Normal of the bin
+
+    std::vector<float> thresholds; // Projections of the points of the heavisides on the normal, in increasing order,
+                                   // padded with infinities to a power of two for the branchless binary search
+
+    std::vector<int> heavisides; // Index of the heaviside of each threshold
+};
+
+/// \brief Integrate heavisides with orientations snapped to bins: a heaviside covers the samples whose projection on
+/// its normal is below the one of its point. The thresholds of the heavisides of a bin are sorted once, so that each
+/// sample of a pixel only needs a binary search among them, the estimates being the prefix sums of the counts of the
+/// samples in each interval between thresholds.
+static void computeBinnedEstimates(const GLuint *scrambles, const std::vector<Heaviside> &heavisides,
+                                   SequenceTable table, int dimension, int spp, int pixelCount,
+                                   std::vector<float> &estimates, int binCount) {
+    const double PI = 3.14159265358979323846;
+    const float SampleWeight = 1.f / spp;
+    const double Div = 1.0 / (1ULL << 32);
+
+    const int heavisideCount = (int)heavisides.size();
+
+    std::vector<OrientationBin> bins(binCount);
+    for(int b = 0; b < binCount; ++b) {
+        bins[b].nx = float(std::cos(2 * PI * b / binCount));
+        bins[b].ny = float(std::sin(2 * PI * b / binCount));
+    }
+
+    for(int j = 0; j < heavisideCount; ++j) {
+        // The nearest of the bins
+        double angle = std::atan2(heavisides[j].ny, heavisides[j].nx);
+        int b = int(std::lround(angle * binCount / (2 * PI))) % binCount;
+
+        bins[b < 0 ? b + binCount : b].heavisides.push_back(j);
+    }
+
+    for(OrientationBin &bin : bins) {
+        std::vector<float> thresholds;
+        for(int j : bin.heavisides)
+            thresholds.push_back(heavisides[j].px * bin.nx + heavisides[j].py * bin.ny);
+
+        std::vector<int> order(bin.heavisides.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return thresholds[a] < thresholds[b]; });
+
+        std::vector<int> heavisideIndices = bin.heavisides;
+        for(size_t k = 0; k < order.size(); ++k) {
+            bin.thresholds.push_back(thresholds[order[k]]);
+            bin.heavisides[k] = heavisideIndices[order[k]];
+        }
+
+        size_t padded = 1;
+        while(padded < order.size())
+            padded *= 2;
+        bin.thresholds.resize(padded, std::numeric_limits<float>::infinity());
+    }
+
+#pragma omp parallel
+    {
+        std::vector<float> samples(2 * spp);
+        std::vector<int> counts(heavisideCount + 1);
+
+#pragma omp for
+        for(int i = 0; i < pixelCount; ++i) {
+            const GLuint *scramble = &scrambles[4 * i];
+            float *estimate = &estimates[size_t(i) * heavisideCount];
+
+            for(int k = 0; k < spp; ++k) {
+                samples[2 * k] = float(((table[k][dimension] ^ scramble[0]) + 0.5) * Div);
+                samples[2 * k + 1] = float(((table[k][dimension + 1] ^ scramble[1]) + 0.5) * Div);
+            }
+
+            for(const OrientationBin &bin : bins) {
+                const int n = (int)bin.heavisides.size();
+                if(n == 0)
+                    continue;
+
+                // A sample is below all the thresholds from the first one above its projection, found with
+                // conditional moves rather than branches the samples would mispredict half of the time
+                const float *thresholds = bin.thresholds.data();
+                const int padded = (int)bin.thresholds.size();
+
+                std::fill(counts.begin(), counts.begin() + n + 1, 0);
+                for(int k = 0; k < spp; ++k) {
+                    float projection = samples[2 * k] * bin.nx + samples[2 * k + 1] * bin.ny;
+
+                    int first = 0;
+                    for(int step = padded / 2; step > 0; step /= 2)
+                        first += thresholds[first + step - 1] <= projection ? step : 0;
+                    first += thresholds[first] <= projection;
+
+                    counts[std::min(first, n)]++;
+                }
+
+                int below = 0;
+                for(int t = 0; t < n; ++t) {
+                    below += counts[t];
+                    estimate[bin.heavisides[t]] = below * SampleWeight;
+                }
+            }
+        }
+    }
+}
+
+void computeEstimates(const GLuint *scrambles, const std::vector<Heaviside> &heavisides, SequenceTable table,
+                      int dimension, int spp, int pixelCount, std::vector<float> &estimates, int orientationBins) {
+    if(orientationBins > 0) {
+        computeBinnedEstimates(scrambles, heavisides, table, dimension, spp, pixelCount, estimates, orientationBins);
+        return;
+    }
+
+    const int heavisideCount = (int)heavisides.size();
+
+#pragma omp parallel for
+    for(int i = 0; i < pixelCount; ++i) {
+        int scrambleIndex = 4 * i;
+
+        for(int j = 0; j < heavisideCount; ++j) {
+            int index = i * heavisideCount + j;
+            estimates[index] = integrateHeaviside(&scrambles[scrambleIndex], heavisides[j], table, dimension, spp);
+        }
+    }
+}
+
+void computeDistanceMatrix(const std::vector<float> &estimates, int heavisideCount, int maskSize,
+                           std::vector<GLfloat> &distanceMatrix) {
+    DistanceMatrixKernel kernel = &computeDistanceMatrixKernel<0, 0>;
+
+    for(const DistanceMatrixKernelEntry &entry : DistanceMatrixKernels)
+        if(entry.maskSize == maskSize && entry.heavisideCount == heavisideCount)
+            kernel = entry.kernel;
+
+    kernel(estimates.data(), heavisideCount, maskSize, distanceMatrix.data());
+}
+
+std::vector<GLfloat> preintegrateDisplay(const GLuint *scrambling, SequenceTable table, int dimension, int spp,
+                                         int pixelCount) {
+    // The pair of dimensions of the table, contiguous for the vectorized loop
+    std::vector<GLuint> samples(2 * spp);
+    for(int j = 0; j < spp; ++j) {
+        samples[j] = table[j][dimension];
+        samples[spp + j] = table[j][dimension + 1];
+    }
+    const GLuint *xs = samples.data();
+    const GLuint *ys = xs + spp;
+
+    std::vector<GLfloat> result(pixelCount);
+
+    // The display only needs the 24 top bits of the samples, which convert to float without the unsigned conversion
+    const float Div = 1.f / (1 << 24);
+    const int BlockSize = 256;
+
+    double variance = 0.0;
+
+#pragma omp parallel for reduction(+ : variance)
+    for(int i = 0; i < pixelCount; ++i) {
+        const GLuint scrambleX = scrambling[4 * i];
+        const GLuint scrambleY = scrambling[4 * i + 1];
+
+        // The vector lanes sum blocks of samples in single precision, the blocks are summed in double precision
+        double sum = 0.0;
+        for(int first = 0; first < spp; first += BlockSize) {
+            const int last = std::min(first + BlockSize, spp);
+
+            float blockSum = 0.f;
+
+#pragma omp simd reduction(+ : blockSum)
+            for(int j = first; j < last; ++j) {
+                float x = (int((xs[j] ^ scrambleX) >> 8) + 0.5f) * Div;
+                float y = (int((ys[j] ^ scrambleY) >> 8) + 0.5f) * Div;
+                blockSum += exponential(-x * x - y * y);
+            }
+
+            sum += blockSum;
+        }
+
+        result[i] = float(sum / spp - 0.5577462854);
+        variance += double(result[i]) * result[i];
+    }
+    variance /= pixelCount;
+    float stddev = float(std::sqrt(variance));
+
+    // Set the standard deviation to 1/4
+#pragma omp parallel for
+    for(int i = 0; i < pixelCount; ++i)
+        result[i] = result[i] / (4 * stddev) + 0.5f;
+
+    return result;
+}
+
+double maskEnergy(const GLuint *texels, const GLfloat *distanceMatrix, int maskSize, int size, float sigma,
+                  int radius) {
+    MaskEnergyKernel kernel = &maskEnergyKernel<0, 0>;
+
+    for(const MaskEnergyKernelEntry &entry : MaskEnergyKernels)
+        if(entry.maskSize == maskSize && entry.radius == radius)
+            kernel = entry.kernel;
+
+    return kernel(texels, distanceMatrix, maskSize, size, sigma, radius);
+}
+
+std::vector<GLuint> optimizeRanking(const GLuint *scrambles, const std::vector<Heaviside> &heavisides,
+                                    SequenceTable table, int dimension, int spp, int maskSize, float sigma, int radius,
+                                    Philox &generator) {
+    // The pixels updated together are further apart than the radius, so they never see each other
+    const int PhaseStride = 8;
+    const int MaxSweeps = 32;
+
+    const int heavisideCount = (int)heavisides.size();
+    const int pixelCount = maskSize * maskSize;
+    const float sigma_i2 = sigma * sigma;
+
+    // Offsets and weights of the window around a pixel
+    std::vector<int> offsets;
+    std::vector<float> weights;
+    for(int dy = -radius; dy <= radius; ++dy) {
+        for(int dx = -radius; dx <= radius; ++dx) {
+            if(dx != 0 || dy != 0) {
+                offsets.push_back(dx);
+                offsets.push_back(dy);
+                weights.push_back(std::exp(-(dx * dx + dy * dy) / sigma_i2));
+            }
+        }
+    }
+
+    std::vector<GLuint> keys(pixelCount, 0U);
+    std::vector<GLuint> choices(pixelCount);
+
+    // The estimates of the two candidate prefixes of each pixel
+    std::vector<float> estimates(2 * pixelCount * heavisideCount);
+
+    for(int prefix = spp / 2; prefix >= 1; prefix /= 2) {
+#pragma omp parallel for
+        for(int i = 0; i < pixelCount; ++i) {
+            for(int c = 0; c < 2; ++c) {
+                int firstSample = int(keys[i]) | c * prefix;
+                float *estimate = &estimates[(2 * i + c) * heavisideCount];
+
+                for(int j = 0; j < heavisideCount; ++j)
+                    estimate[j] =
+                        integrateHeaviside(&scrambles[4 * i], heavisides[j], table, dimension, prefix, firstSample);
+            }
+        }
+
+        for(GLuint &choice : choices)
+            choice = generator() >> 31;
+
+        for(int sweep = 0; sweep < MaxSweeps; ++sweep) {
+            int changes = 0;
+
+            for(int phase = 0; phase < PhaseStride * PhaseStride; ++phase) {
+#pragma omp parallel for reduction(+ : changes)
+                for(int i = 0; i < pixelCount / (PhaseStride * PhaseStride); ++i) {
+                    int x = (i % (maskSize / PhaseStride)) * PhaseStride + phase % PhaseStride;
+                    int y = (i / (maskSize / PhaseStride)) * PhaseStride + phase / PhaseStride;
+                    int pixel = y * maskSize + x;
+
+                    float energy[2] = {0.f, 0.f};
+                    for(int k = 0; k < (int)weights.size(); ++k) {
+                        int qx = (x + offsets[2 * k] + maskSize) % maskSize;
+                        int qy = (y + offsets[2 * k + 1] + maskSize) % maskSize;
+                        int q = qy * maskSize + qx;
+                        const float *neighbor = &estimates[(2 * q + choices[q]) * heavisideCount];
+
+                        for(int c = 0; c < 2; ++c)
+                            energy[c] += weights[k] * squaredL2Norm(&estimates[(2 * pixel + c) * heavisideCount],
+                                                                    neighbor, heavisideCount);
+                    }
+
+                    // Same convention as the scrambles optimization: the energy is maximized
+                    GLuint best = energy[1] > energy[0] ? 1U : 0U;
+                    if(best != choices[pixel]) {
+                        choices[pixel] = best;
+                        ++changes;
+                    }
+                }
+            }
+
+            if(changes == 0)
+                break;
+        }
+
+        for(int i = 0; i < pixelCount; ++i)
+            keys[i] |= choices[i] * prefix;
+    }
+
+    return keys;
+}
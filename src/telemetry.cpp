@@ -0,0 +1,202 @@
+#ifdef _WIN32
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <telemetry.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+
+
+// Memory queries of the vendor extensions, not exposed by GLAD
+constexpr GLenum GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX = 0x9048;
+constexpr GLenum GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX = 0x9049;
+constexpr GLenum GL_TEXTURE_FREE_MEMORY_ATI = 0x87FC;
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+Telemetry::Scope::Scope(const char *phase)
+    : m_phase(phase), m_wallStart(steady_clock::now()), m_cpuStart(processCpuSeconds()) {}
+
+Telemetry::Scope::~Scope() {
+    telemetry().addPhase(m_phase, duration<double>(steady_clock::now() - m_wallStart).count(),
+                         processCpuSeconds() - m_cpuStart);
+}
+
+void Telemetry::enable() {
+    m_enabled = true;
+
+    glGenQueries(1, &m_timerQuery);
+
+    GLint extensionCount;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+    for(int i = 0; i < extensionCount; ++i) {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+
+        if(std::strcmp(extension, "GL_NVX_gpu_memory_info") == 0) {
+            m_memoryQuery = GL_GPU_MEMORY_INFO_CURRENT_AVAILABLE_VIDMEM_NVX;
+            glGetIntegerv(GL_GPU_MEMORY_INFO_TOTAL_AVAILABLE_MEMORY_NVX, &m_memoryReference);
+        } else if(std::strcmp(extension, "GL_ATI_meminfo") == 0) {
+            // The first value is the total free memory of the pool, the others are the free blocks
+            GLint values[4];
+            glGetIntegerv(GL_TEXTURE_FREE_MEMORY_ATI, values);
+
+            m_memoryQuery = GL_TEXTURE_FREE_MEMORY_ATI;
+            m_memoryReference = values[0];
+        }
+    }
+}
+
+void Telemetry::freeGLRessources() {
+    if(m_timerQuery != 0)
+        glDeleteQueries(1, &m_timerQuery);
+}
+
+bool Telemetry::enabled() const { return m_enabled; }
+
+void Telemetry::addPhase(const std::string &phase, double wallSeconds, double cpuSeconds) {
+    if(!m_enabled)
+        return;
+
+    Phase &p = m_phases[phase];
+    ++p.count;
+    p.wallSeconds += wallSeconds;
+    p.cpuSeconds += cpuSeconds;
+}
+
+void Telemetry::beginBatch() {
+    m_batchWallStart = steady_clock::now();
+    m_batchCpuStart = processCpuSeconds();
+    m_batchGpuTime = 0;
+}
+
+void Telemetry::beginDispatch() {
+    if(m_enabled)
+        glBeginQuery(GL_TIME_ELAPSED, m_timerQuery);
+}
+
+void Telemetry::endDispatch() {
+    if(!m_enabled)
+        return;
+
+    glEndQuery(GL_TIME_ELAPSED);
+
+    GLuint64 elapsed;
+    glGetQueryObjectui64v(m_timerQuery, GL_QUERY_RESULT, &elapsed);
+    m_batchGpuTime += elapsed;
+}
+
+void Telemetry::endBatch(int dimension, int level, int dispatchCount, int acceptedSwaps) {
+    if(!m_enabled)
+        return;
+
+    m_batches.push_back({dimension, level, dispatchCount, acceptedSwaps,
+                         duration<double>(steady_clock::now() - m_batchWallStart).count(),
+                         processCpuSeconds() - m_batchCpuStart, m_batchGpuTime * 1e-9});
+
+    sampleGpuMemory();
+}
+
+void Telemetry::setAllocatedGpuMemory(GLint64 bytes) { m_allocatedGpuMemory = bytes; }
+
+void Telemetry::sampleGpuMemory() {
+    if(!m_enabled || m_memoryQuery == 0)
+        return;
+
+    GLint values[4];
+    glGetIntegerv(m_memoryQuery, values);
+
+    GLint64 used = GLint64(m_memoryReference - values[0]) * 1024;
+    m_peakDriverGpuMemory = std::max(m_peakDriverGpuMemory, used);
+}
+
+bool Telemetry::write(const std::string &filename) const {
+    std::ofstream file(filename);
+    if(!file)
+        return false;
+
+    file << std::setprecision(9);
+    file << "{\n";
+    file << "    \"wallSeconds\": " << duration<double>(steady_clock::now() - m_start).count() << ",\n";
+    file << "    \"cpuSeconds\": " << processCpuSeconds() << ",\n";
+    file << "    \"peakResidentBytes\": " << peakResidentMemory() << ",\n";
+    file << "    \"gpuMemory\": {\"allocatedBytes\": " << m_allocatedGpuMemory << ", \"peakDriverUsedBytes\": ";
+    if(m_peakDriverGpuMemory < 0)
+        file << "null";
+    else
+        file << m_peakDriverGpuMemory;
+    file << "},\n";
+
+    file << "    \"phases\": {";
+    for(auto it = m_phases.begin(); it != m_phases.end(); ++it) {
+        file << (it == m_phases.begin() ? "\n" : ",\n");
+        file << "        \"" << it->first << "\": {\"count\": " << it->second.count
+             << ", \"wallSeconds\": " << it->second.wallSeconds << ", \"cpuSeconds\": " << it->second.cpuSeconds
+             << "}";
+    }
+    file << "\n    },\n";
+
+    file << "    \"batches\": [";
+    for(int i = 0; i < (int)m_batches.size(); ++i) {
+        const Batch &batch = m_batches[i];
+
+        file << (i == 0 ? "\n" : ",\n");
+        file << "        {\"dimension\": " << batch.dimension << ", \"level\": " << batch.level
+             << ", \"dispatches\": " << batch.dispatchCount << ", \"acceptedSwaps\": " << batch.acceptedSwaps
+             << ", \"wallSeconds\": " << batch.wallSeconds << ", \"cpuSeconds\": " << batch.cpuSeconds
+             << ", \"gpuSeconds\": " << batch.gpuSeconds << "}";
+    }
+    file << "\n    ]\n";
+    file << "}\n";
+
+    return bool(file);
+}
+
+Telemetry &telemetry() {
+    static Telemetry instance;
+
+    return instance;
+}
+
+double processCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user);
+
+    auto seconds = [](const FILETIME &t) {
+        return (double(t.dwHighDateTime) * 4294967296.0 + double(t.dwLowDateTime)) * 1e-7;
+    };
+
+    return seconds(kernel) + seconds(user);
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) * 1e-6;
+#endif
+}
+
+int64_t peakResidentMemory() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+
+    return int64_t(counters.PeakWorkingSetSize);
+#else
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+
+#ifdef __APPLE__
+    return int64_t(usage.ru_maxrss);
+#else
+    return int64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
@@ -0,0 +1,180 @@
+#include <evaluation.hpp>
+#include <exporter.hpp>
+
+#include <chrono>
+#include <cstring>
+
+
+// Evaluate the quality of an exported mask from the power spectrum of its integration error
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct Arguments {
+    std::string maskFile;
+
+    int spp = 0; // Samples per pixel of the evaluation, 0 for the sample count of the mask
+
+    int integrandCount = 64;
+
+    uint32_t seed = 0;
+
+    double cutoff = 0.25; // Relative to the Nyquist frequency
+
+    double maxLowFrequencyEnergy = 1.0; // Above it, the evaluation fails
+
+    std::string spectrumFile; // CSV dump of the radial spectrum, empty to disable it
+};
+
+bool handleArgs(int argc, char **argv, Arguments &arguments);
+
+
+int main(int argc, char **argv) {
+    Arguments arguments;
+    if(!handleArgs(argc, argv, arguments)) {
+        ERROR << "Invalid arguments, usage :\n"
+                 "./Evaluator MaskHeader [Options]\n"
+                 "Options:\n"
+                 "    --spp SampleCount                 Samples per pixel of the evaluation (default: the sample "
+                 "count of the mask)\n"
+                 "    --integrands Count                Heavisides integrated with each pair of dimensions "
+                 "(default: 64)\n"
+                 "    --seed Seed                       Seed of the heavisides (default: 0)\n"
+                 "    --cutoff Frequency                Cutoff of the low frequency energy, relative to the Nyquist "
+                 "frequency (default: 0.25)\n"
+                 "    --max-low-frequency-energy Share  Fail if the low frequency energy of a pair of dimensions is "
+                 "above Share\n"
+                 "    --spectrum SpectrumFile           Write the radial power spectrum and the anisotropy as CSV\n"
+                 "Note: MaskHeader was exported by the optimizer, 0 < Frequency <= 1"
+              << std::endl;
+
+        return INVALID_ARGUMENTS;
+    }
+
+    steady_clock::time_point start = steady_clock::now();
+
+    EvaluatedMask mask;
+    if(!loadMaskHeader(arguments.maskFile.c_str(), mask.settings, mask.scrambles, mask.rankings)) {
+        ERROR << "Could not load the mask " << arguments.maskFile << std::endl;
+
+        return MASK_LOAD_ERROR;
+    }
+
+    const OptimizerSettings &settings = mask.settings;
+    const int size = settings.maskSize;
+    const int spp = arguments.spp > 0 ? arguments.spp : settings.spp;
+
+    // The ranked prefixes are blocks of samples, so only the powers of two up to the optimized count are meaningful
+    if(spp > 4096 || (!mask.rankings.empty() && (spp > settings.spp || (spp & (spp - 1)) != 0))) {
+        ERROR << "Cannot evaluate the mask with " << spp << " samples per pixel" << std::endl;
+
+        return INVALID_ARGUMENTS;
+    }
+
+    LOG << "Evaluating " << arguments.maskFile << ": " << size << "x" << size << ", " << settings.frames
+        << " frame(s), " << settings.dimensions << " optimized dimensions, " << spp << " spp"
+        << (mask.rankings.empty() ? "" : ", ranked")
+        << (settings.sequence == bluenoise::Sequence::SobolOwen ? ", table-free sequence" : "") << std::endl;
+
+    std::vector<Heaviside> heavisides =
+        generateHeavisides(arguments.integrandCount, Philox(arguments.seed, RandomPurpose::Evaluation));
+
+    const double whiteShare = lowFrequencyShare(size, arguments.cutoff);
+
+    std::vector<double> error;
+    std::vector<double> total(size_t(size) * size, 0.0);
+
+    bool passed = true;
+    for(int d = 0; d < settings.dimensions; d += 2) {
+        std::vector<double> power(size_t(size) * size, 0.0);
+
+        double squaredError = 0.0;
+        for(int frame = 0; frame < settings.frames; ++frame) {
+            for(const Heaviside &heaviside : heavisides) {
+                errorImage(mask, heaviside, d, frame, spp, error);
+                accumulatePowerSpectrum(error, size, power);
+
+                for(double e : error)
+                    squaredError += e * e;
+            }
+        }
+
+        const int imageCount = settings.frames * arguments.integrandCount;
+        for(size_t i = 0; i < power.size(); ++i)
+            total[i] += power[i] / imageCount;
+
+        double rms = std::sqrt(squaredError / (double(imageCount) * size * size));
+        double low = lowFrequencyEnergy(power, size, arguments.cutoff);
+
+        LOG << "Dimensions " << d + 1 << " and " << d + 2 << ": error standard deviation " << rms
+            << ", low frequency energy " << 100.0 * low << "%" << std::endl;
+
+        if(low > arguments.maxLowFrequencyEnergy)
+            passed = false;
+    }
+
+    RadialSpectrum spectrum = radialAverage(total, size);
+
+    double anisotropy = 0.0;
+    for(int r = 1; r < (int)spectrum.anisotropy.size(); ++r)
+        anisotropy += spectrum.anisotropy[r];
+    anisotropy /= double(spectrum.anisotropy.size() - 1);
+
+    LOG << "Low frequency energy below " << arguments.cutoff << " x Nyquist: "
+        << 100.0 * lowFrequencyEnergy(total, size, arguments.cutoff) << "% (white noise: " << 100.0 * whiteShare
+        << "%)" << std::endl;
+    LOG << "Mean anisotropy: " << anisotropy << " dB" << std::endl;
+
+    if(!arguments.spectrumFile.empty()) {
+        std::ofstream file(arguments.spectrumFile);
+        file << "frequency,power,anisotropy\n";
+        for(int r = 0; r < (int)spectrum.power.size(); ++r)
+            file << double(r) / size << "," << spectrum.power[r] << "," << spectrum.anisotropy[r] << "\n";
+
+        if(!file)
+            WARN << "Could not write the spectrum in " << arguments.spectrumFile << std::endl;
+    }
+
+    LOG << "Evaluation done in " << duration<double>(steady_clock::now() - start).count() << "s" << std::endl;
+
+    if(!passed) {
+        ERROR << "The low frequency energy is above " << 100.0 * arguments.maxLowFrequencyEnergy << "%" << std::endl;
+
+        return QUALITY_GATE_ERROR;
+    }
+
+    return SUCCESS;
+}
+
+bool handleArgs(int argc, char **argv, Arguments &arguments) {
+    if(argc < 2 || std::strncmp(argv[1], "--", 2) == 0)
+        return false;
+
+    arguments.maskFile = argv[1];
+
+    for(int i = 2; i < argc; ++i) {
+        std::string option(argv[i]);
+
+        if(i + 1 == argc)
+            return false;
+
+        std::string value(argv[++i]);
+
+        if(option == "--spp") {
+            arguments.spp = std::atoi(value.c_str());
+        } else if(option == "--integrands") {
+            arguments.integrandCount = std::atoi(value.c_str());
+        } else if(option == "--seed") {
+            arguments.seed = (uint32_t)std::strtoul(value.c_str(), nullptr, 10);
+        } else if(option == "--cutoff") {
+            arguments.cutoff = std::atof(value.c_str());
+        } else if(option == "--max-low-frequency-energy") {
+            arguments.maxLowFrequencyEnergy = std::atof(value.c_str());
+        } else if(option == "--spectrum") {
+            arguments.spectrumFile = value;
+        } else
+            return false;
+    }
+
+    return arguments.spp >= 0 && arguments.integrandCount > 0 && arguments.cutoff > 0.0 && arguments.cutoff <= 1.0;
+}
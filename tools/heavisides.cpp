@@ -0,0 +1,281 @@
+#include <precomputation.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+
+
+// Study of the heaviside banks: the distance matrices estimated with few heavisides are compared to a reference one
+// estimated with many, to find the smallest count of each bank ranking the distances as well as the default bank
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct Arguments {
+    int maskSize = 32;
+
+    int spp = 16;
+
+    int dimension = 0; // First dimension of the pair of the sequences
+
+    bluenoise::Sequence sequence = bluenoise::Sequence::Table;
+
+    int referenceCount = 4096; // Random heavisides of the reference distances
+
+    std::vector<int> counts = {32, 64, 128, 256, 512, 1024}; // Sorted and deduplicated by handleArgs
+
+    int repetitions = 3; // Banks drawn with different seeds for each count, their agreements are averaged
+
+    int triplets = 200000;
+
+    int orientationBins = 0; // Orientation bins of the studied banks, the reference having exact orientations
+
+    uint32_t seed = 0;
+};
+
+/// \brief A triplet of sequences (i, j, k): the distance between i and j is compared to the one between i and k.
+struct Triplet {
+    int i, j, k;
+};
+
+bool handleArgs(int argc, char **argv, Arguments &arguments);
+
+/// \brief Estimate the distance matrix of the sequences of the pixels with a bank of heavisides.
+/// \param scrambles The scramble values of each pixel, 4 values per pixel.
+/// \param heavisides The bank.
+/// \param arguments The parameters of the study.
+/// \param orientationBins The orientation bins of the estimates, 0 for exact orientations.
+/// \param distanceMatrix The upper triangular distance matrix, indexed with distanceIndex.
+static void estimateDistances(const std::vector<GLuint> &scrambles, const std::vector<Heaviside> &heavisides,
+                              const Arguments &arguments, int orientationBins, std::vector<GLfloat> &distanceMatrix) {
+    const int pixelCount = arguments.maskSize * arguments.maskSize;
+
+    std::vector<float> estimates(size_t(pixelCount) * heavisides.size());
+    computeEstimates(scrambles.data(), heavisides, sequenceTable(arguments.sequence), arguments.dimension,
+                     arguments.spp, pixelCount, estimates, orientationBins);
+
+    distanceMatrix.resize(distanceMatrixSize(pixelCount));
+    computeDistanceMatrix(estimates, (int)heavisides.size(), arguments.maskSize, distanceMatrix);
+}
+
+static GLfloat distance(const std::vector<GLfloat> &distanceMatrix, int i, int j, int pixelCount) {
+    return distanceMatrix[distanceIndex(std::min(i, j), std::max(i, j), pixelCount)];
+}
+
+
+int main(int argc, char **argv) {
+    Arguments arguments;
+    if(!handleArgs(argc, argv, arguments)) {
+        ERROR << "Invalid arguments, usage :\n"
+                 "./HeavisideStudy [Options]\n"
+                 "Options:\n"
+                 "    --size Size                       Side of the mask, its pixels having random scrambles "
+                 "(default: 32)\n"
+                 "    --spp SampleCount                 Samples per pixel (default: 16)\n"
+                 "    --dimension Dimension             First dimension of the pair of the sequences (default: 0)\n"
+                 "    --sequence table|sobol            Sequence of the pixels (default: table)\n"
+                 "    --reference Count                 Random heavisides of the reference distances (default: 4096)\n"
+                 "    --counts Count,Count,...          Heaviside counts of the banks, powers of two (default: "
+                 "32,64,128,256,512,1024)\n"
+                 "    --repetitions Count               Banks drawn with different seeds for each count "
+                 "(default: 3)\n"
+                 "    --triplets Count                  Triplets of sequences the rankings are compared on "
+                 "(default: 200000)\n"
+                 "    --orientation-bins Count          Orientation bins of the studied banks (default: 0, exact "
+                 "orientations)\n"
+                 "    --seed Seed                       Seed of the scrambles, of the banks and of the triplets "
+                 "(default: 0)"
+              << std::endl;
+
+        return INVALID_ARGUMENTS;
+    }
+
+    const int pixelCount = arguments.maskSize * arguments.maskSize;
+    steady_clock::time_point start = steady_clock::now();
+
+    // The sequences of the pixels, scrambled as in the optimizer
+    std::vector<GLuint> scrambles(4 * pixelCount);
+    const Philox scrambleStream(arguments.seed, RandomPurpose::Scrambles, arguments.dimension / 2);
+    for(int i = 0; i < pixelCount; ++i) {
+        Philox::Block bits = scrambleStream.block(i);
+
+        scrambles[4 * i] = bits[0];
+        scrambles[4 * i + 1] = bits[1];
+        scrambles[4 * i + 2] = i;
+        scrambles[4 * i + 3] = 0U;
+    }
+
+    // The reference bank is drawn from a stream of its own, so that it is independent of all the studied banks
+    LOG << "Estimating the reference distances with " << arguments.referenceCount << " random heavisides..."
+        << std::endl;
+    std::vector<GLfloat> reference;
+    estimateDistances(scrambles,
+                      generateHeavisides(arguments.referenceCount, Philox(arguments.seed, RandomPurpose::Evaluation)),
+                      arguments, 0, reference);
+
+    std::vector<Triplet> triplets(arguments.triplets);
+    const Philox tripletStream(arguments.seed, RandomPurpose::Evaluation, 1);
+    for(int t = 0; t < arguments.triplets; ++t) {
+        Philox::Block bits = tripletStream.block(t);
+
+        triplets[t] = {int(uniformInteger(bits[0], pixelCount)), int(uniformInteger(bits[1], pixelCount)),
+                       int(uniformInteger(bits[2], pixelCount))};
+    }
+
+    double referenceMean = 0.0;
+    for(GLfloat d : reference)
+        referenceMean += d;
+    referenceMean /= double(reference.size()) * arguments.referenceCount;
+
+    const HeavisideBank banks[] = {HeavisideBank::Random, HeavisideBank::Stratified, HeavisideBank::Sobol};
+    const char *bankNames[] = {"random", "stratified", "sobol"};
+
+    // Agreement of each bank and count, averaged over the repetitions
+    std::vector<std::vector<double>> agreements(3, std::vector<double>(arguments.counts.size(), 0.0));
+
+    LOG << "bank        count  agreement  relative error  precomputation" << std::endl;
+    for(int b = 0; b < 3; ++b) {
+        for(int c = 0; c < (int)arguments.counts.size(); ++c) {
+            const int count = arguments.counts[c];
+
+            double error = 0.0;
+            double seconds = 0.0;
+            for(int r = 0; r < arguments.repetitions; ++r) {
+                steady_clock::time_point precomputationStart = steady_clock::now();
+
+                std::vector<GLfloat> distances;
+                const Philox stream(arguments.seed + 1 + r, RandomPurpose::Heavisides, arguments.dimension / 2);
+                estimateDistances(scrambles, generateHeavisides(count, stream, banks[b]), arguments,
+                                  arguments.orientationBins, distances);
+
+                seconds += duration<double>(steady_clock::now() - precomputationStart).count();
+
+                // Share of the triplets whose closest sequence is the same as with the reference distances
+                int agreed = 0;
+#pragma omp parallel for reduction(+ : agreed)
+                for(int t = 0; t < arguments.triplets; ++t) {
+                    const Triplet &triplet = triplets[t];
+
+                    bool closer = distance(distances, triplet.i, triplet.j, pixelCount) <
+                                  distance(distances, triplet.i, triplet.k, pixelCount);
+                    bool referenceCloser = distance(reference, triplet.i, triplet.j, pixelCount) <
+                                           distance(reference, triplet.i, triplet.k, pixelCount);
+
+                    agreed += closer == referenceCloser;
+                }
+                agreements[b][c] += double(agreed) / arguments.triplets / arguments.repetitions;
+
+                // Error of the distances per heaviside, relative to the mean reference distance
+                double squaredError = 0.0;
+#pragma omp parallel for reduction(+ : squaredError)
+                for(size_t i = 0; i < distances.size(); ++i) {
+                    double e = double(distances[i]) / count - double(reference[i]) / arguments.referenceCount;
+                    squaredError += e * e;
+                }
+                error += std::sqrt(squaredError / distances.size()) / referenceMean / arguments.repetitions;
+            }
+
+            std::stringstream line;
+            line.setf(std::ios::fixed);
+            line.precision(4);
+            line << bankNames[b] << std::string(12 - std::strlen(bankNames[b]), ' ') << std::setw(5) << count
+                 << std::setw(11) << agreements[b][c] << std::setw(16) << error;
+            line.precision(3);
+            line << std::setw(15) << seconds / arguments.repetitions << "s";
+
+            LOG << line.str() << std::endl;
+        }
+    }
+
+    // The optimizer uses HeavisideCount random heavisides by default
+    int defaultIndex = -1;
+    for(int c = 0; c < (int)arguments.counts.size(); ++c)
+        if(arguments.counts[c] == HeavisideCount)
+            defaultIndex = c;
+
+    if(defaultIndex < 0) {
+        WARN << "The counts do not include the default count " << HeavisideCount << ", no bank is compared to it"
+             << std::endl;
+    } else {
+        const double target = agreements[0][defaultIndex];
+
+        for(int b = 0; b < 3; ++b) {
+            int smallest = -1;
+            for(int c = (int)arguments.counts.size() - 1; c >= 0 && agreements[b][c] >= target; --c)
+                smallest = arguments.counts[c];
+
+            if(smallest > 0)
+                LOG << "Smallest " << bankNames[b] << " bank ranking the distances as well as " << HeavisideCount
+                    << " random heavisides: " << smallest << " (--heavisides " << bankNames[b]
+                    << " --heaviside-count " << smallest << ")" << std::endl;
+            else
+                LOG << "No " << bankNames[b] << " bank ranks the distances as well as " << HeavisideCount
+                    << " random heavisides" << std::endl;
+        }
+    }
+
+    LOG << "Study done in " << duration<double>(steady_clock::now() - start).count() << "s" << std::endl;
+
+    return SUCCESS;
+}
+
+bool handleArgs(int argc, char **argv, Arguments &arguments) {
+    for(int i = 1; i < argc; ++i) {
+        std::string option(argv[i]);
+
+        if(i + 1 == argc)
+            return false;
+
+        std::string value(argv[++i]);
+
+        if(option == "--size") {
+            arguments.maskSize = std::atoi(value.c_str());
+        } else if(option == "--spp") {
+            arguments.spp = std::atoi(value.c_str());
+        } else if(option == "--dimension") {
+            arguments.dimension = std::atoi(value.c_str());
+        } else if(option == "--sequence") {
+            if(value == "table")
+                arguments.sequence = bluenoise::Sequence::Table;
+            else if(value == "sobol")
+                arguments.sequence = bluenoise::Sequence::SobolOwen;
+            else
+                return false;
+        } else if(option == "--reference") {
+            arguments.referenceCount = std::atoi(value.c_str());
+        } else if(option == "--counts") {
+            // A comma separated list of counts
+            arguments.counts.clear();
+
+            std::stringstream counts(value);
+            std::string count;
+            while(std::getline(counts, count, ','))
+                arguments.counts.push_back(std::atoi(count.c_str()));
+        } else if(option == "--repetitions") {
+            arguments.repetitions = std::atoi(value.c_str());
+        } else if(option == "--triplets") {
+            arguments.triplets = std::atoi(value.c_str());
+        } else if(option == "--orientation-bins") {
+            arguments.orientationBins = std::atoi(value.c_str());
+        } else if(option == "--seed") {
+            arguments.seed = (uint32_t)std::strtoul(value.c_str(), nullptr, 10);
+        } else
+            return false;
+    }
+
+    for(int count : arguments.counts)
+        if(count < 1 || (count & (count - 1)) != 0)
+            return false;
+
+    // The search of the smallest count walks them in ascending order
+    std::sort(arguments.counts.begin(), arguments.counts.end());
+    arguments.counts.erase(std::unique(arguments.counts.begin(), arguments.counts.end()), arguments.counts.end());
+
+    return arguments.maskSize >= 4 && arguments.spp > 0 && arguments.spp <= 4096 && arguments.dimension >= 0 &&
+           arguments.dimension % 2 == 0 && arguments.dimension + 1 < bluenoise::SequenceDimensions &&
+           arguments.referenceCount > 0 && !arguments.counts.empty() && arguments.repetitions > 0 &&
+           arguments.triplets > 0 && arguments.orientationBins >= 0;
+}
@@ -0,0 +1,386 @@
+#include <evaluation.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <omp.h>
+
+
+// End to end benchmark of a mask and of the runtime sampler: analytic integrands are rendered in tiles with many
+// threads, and the error of the frames is compared to the exact integrals
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct Arguments {
+    std::string maskFile;
+
+    int width = 1920;
+
+    int height = 1080;
+
+    int tileSize = 16;
+
+    int spp = 0; // 0 for the sample count of the mask
+
+    int frames = 4;
+
+    int threads = 0; // 0 for all the cores
+
+    int dimension = 0; // First dimension of the pair used by the integrands
+
+    double cutoff = 0.25; // Relative to the Nyquist frequency
+
+    std::string spectrumPrefix; // Prefix of the CSV dumps of the radial spectra, empty to disable them
+};
+
+enum Integrand { Gaussian, Heaviside, Occlusion, IntegrandCount };
+
+static const char *IntegrandNames[IntegrandCount] = {"gaussian", "heaviside", "occlusion"};
+
+// Integral of exp(-x^2 - y^2) over the unit square
+static const double GaussianIntegral = 0.5577462854;
+
+// Occlusion: a floor lit by a unit square light at height 1 through a square blocker at height BlockerHeight. Seen
+// from a point of the floor, the blocker hides an axis aligned square of the light.
+static const float BlockerHeight = 0.5f;
+static const float BlockerMin = 0.3f;
+static const float BlockerMax = 0.7f;
+
+/// \brief The integrands of a pixel, which vary smoothly over the frame like the ones of a rendered image.
+struct PixelIntegrands {
+    // Orientation and point of the heaviside
+    float nx, ny, px, py;
+
+    // Square of the light hidden by the blocker, in the sample space
+    float hiddenMin[2], hiddenMax[2];
+};
+
+static PixelIntegrands pixelIntegrands(int x, int y, int width, int height) {
+    const float PI = 3.14159265359f;
+
+    PixelIntegrands integrands;
+
+    float theta = 4.f * PI * x / width;
+    integrands.nx = std::cos(theta);
+    integrands.ny = std::sin(theta);
+    integrands.px = float(y) / height;
+    integrands.py = 0.5f;
+
+    // The floor point below the pixel, in the coordinates of the light
+    float s[2] = {-0.5f + 2.f * x / width, -0.5f + 2.f * y / height};
+    for(int k = 0; k < 2; ++k) {
+        integrands.hiddenMin[k] = s[k] + (BlockerMin - s[k]) / BlockerHeight;
+        integrands.hiddenMax[k] = s[k] + (BlockerMax - s[k]) / BlockerHeight;
+    }
+
+    return integrands;
+}
+
+/// \brief Compute the area of the part of the unit square on the negative side of a line, by clipping the square.
+static double halfPlaneArea(const PixelIntegrands &integrands) {
+    const double square[4][2] = {{0.0, 0.0}, {1.0, 0.0}, {1.0, 1.0}, {0.0, 1.0}};
+
+    auto side = [&](const double *q) {
+        return (q[0] - integrands.px) * integrands.nx + (q[1] - integrands.py) * integrands.ny;
+    };
+
+    std::vector<std::pair<double, double>> polygon;
+    for(int k = 0; k < 4; ++k) {
+        const double *a = square[k];
+        const double *b = square[(k + 1) % 4];
+        double sa = side(a);
+        double sb = side(b);
+
+        if(sa < 0.0)
+            polygon.push_back({a[0], a[1]});
+        if((sa < 0.0) != (sb < 0.0)) {
+            double t = sa / (sa - sb);
+            polygon.push_back({a[0] + t * (b[0] - a[0]), a[1] + t * (b[1] - a[1])});
+        }
+    }
+
+    double area = 0.0;
+    for(size_t k = 0; k < polygon.size(); ++k) {
+        const std::pair<double, double> &a = polygon[k];
+        const std::pair<double, double> &b = polygon[(k + 1) % polygon.size()];
+        area += a.first * b.second - b.first * a.second;
+    }
+
+    return std::abs(area) / 2.0;
+}
+
+static double reference(Integrand integrand, const PixelIntegrands &integrands) {
+    switch(integrand) {
+    case Gaussian:
+        return GaussianIntegral;
+    case Heaviside:
+        return halfPlaneArea(integrands);
+    default: {
+        double hidden = 1.0;
+        for(int k = 0; k < 2; ++k)
+            hidden *= std::max(0.0, double(std::min(integrands.hiddenMax[k], 1.f) - std::max(integrands.hiddenMin[k], 0.f)));
+
+        return 1.0 - hidden;
+    }
+    }
+}
+
+bool handleArgs(int argc, char **argv, Arguments &arguments);
+
+
+int main(int argc, char **argv) {
+    Arguments arguments;
+    if(!handleArgs(argc, argv, arguments)) {
+        ERROR << "Invalid arguments, usage :\n"
+                 "./RenderBenchmark MaskHeader [Options]\n"
+                 "Options:\n"
+                 "    --resolution Width Height         Size of the frames (default: 1920 1080)\n"
+                 "    --tile TileSize                   Side of the tiles rendered by a thread (default: 16)\n"
+                 "    --spp SampleCount                 Samples per pixel (default: the sample count of the mask)\n"
+                 "    --frames FrameCount               Frames rendered (default: 4)\n"
+                 "    --threads ThreadCount             Threads rendering the tiles (default: all the cores)\n"
+                 "    --dimension Dimension             First dimension of the pair sampled (default: 0)\n"
+                 "    --cutoff Frequency                Cutoff of the low frequency energy, relative to the Nyquist "
+                 "frequency (default: 0.25)\n"
+                 "    --spectrum Prefix                 Write the radial power spectrum of each integrand in "
+                 "Prefix<integrand>.csv\n"
+                 "Note: MaskHeader was exported by the optimizer, the dimension is even, 0 < Frequency <= 1"
+              << std::endl;
+
+        return INVALID_ARGUMENTS;
+    }
+
+    bluenoise::MaskData mask;
+    if(!bluenoise::loadMask(arguments.maskFile.c_str(), mask)) {
+        ERROR << "Could not load the mask " << arguments.maskFile << std::endl;
+
+        return MASK_LOAD_ERROR;
+    }
+
+    const int spp = arguments.spp > 0 ? arguments.spp : mask.spp;
+    if(spp > bluenoise::SequenceSamples ||
+       (!mask.rankingKeys.empty() && (spp > mask.spp || (spp & (spp - 1)) != 0))) {
+        ERROR << "Cannot render the mask with " << spp << " samples per pixel" << std::endl;
+
+        return INVALID_ARGUMENTS;
+    }
+
+    if(arguments.threads > 0)
+        omp_set_num_threads(arguments.threads);
+    const int threads = omp_get_max_threads();
+
+    const int width = arguments.width;
+    const int height = arguments.height;
+    const int tileSize = arguments.tileSize;
+    const int tilesPerRow = (width + tileSize - 1) / tileSize;
+    const int tileCount = tilesPerRow * ((height + tileSize - 1) / tileSize);
+    const size_t pixelCount = size_t(width) * height;
+
+    LOG << "Rendering " << arguments.frames << " frames of " << width << "x" << height << " at " << spp
+        << " spp with " << threads << " threads, in " << tileSize << "x" << tileSize << " tiles" << std::endl;
+
+    bluenoise::Sampler sampler(mask, sequenceTable(bluenoise::Sequence::Table));
+
+    // The exact integrals do not depend on the frame
+    std::vector<float> references(IntegrandCount * pixelCount);
+
+#pragma omp parallel for
+    for(int y = 0; y < height; ++y) {
+        for(int x = 0; x < width; ++x) {
+            PixelIntegrands integrands = pixelIntegrands(x, y, width, height);
+
+            for(int k = 0; k < IntegrandCount; ++k)
+                references[k * pixelCount + size_t(y) * width + x] = float(reference(Integrand(k), integrands));
+        }
+    }
+
+    const int blockSize = mask.size;
+    const int blockCount = (width / blockSize) * (height / blockSize);
+    if(blockCount == 0)
+        WARN << "The frames are smaller than the mask, the error spectra are not computed" << std::endl;
+
+    std::vector<float> estimates(IntegrandCount * pixelCount);
+    std::vector<double> squaredErrors(IntegrandCount, 0.0);
+    std::vector<std::vector<double>> spectra(IntegrandCount, std::vector<double>(size_t(blockSize) * blockSize, 0.0));
+
+    double renderSeconds = 0.0;
+    double samplingSeconds = 0.0;
+    double checksum = 0.0;
+
+    for(int frame = 0; frame < arguments.frames; ++frame) {
+        // Sampling alone, to isolate the cost of the sampler from the one of the integrands
+        steady_clock::time_point start = steady_clock::now();
+
+#pragma omp parallel reduction(+ : checksum)
+        {
+            std::vector<float> samples(size_t(tileSize) * tileSize * 2);
+
+#pragma omp for schedule(dynamic)
+            for(int tile = 0; tile < tileCount; ++tile) {
+                int x0 = (tile % tilesPerRow) * tileSize;
+                int y0 = (tile / tilesPerRow) * tileSize;
+                int columns = std::min(tileSize, width - x0);
+                int rows = std::min(tileSize, height - y0);
+
+                for(int s = 0; s < spp; ++s) {
+                    sampler.sampleTile(y0, x0, rows, columns, frame, s, arguments.dimension, 2, samples.data());
+                    checksum += samples[0];
+                }
+            }
+        }
+
+        samplingSeconds += duration<double>(steady_clock::now() - start).count();
+
+        // Rendering
+        start = steady_clock::now();
+
+#pragma omp parallel
+        {
+            std::vector<float> samples(size_t(tileSize) * tileSize * 2);
+            std::vector<PixelIntegrands> integrands(size_t(tileSize) * tileSize);
+            std::vector<float> sums(size_t(tileSize) * tileSize * IntegrandCount);
+
+#pragma omp for schedule(dynamic)
+            for(int tile = 0; tile < tileCount; ++tile) {
+                int x0 = (tile % tilesPerRow) * tileSize;
+                int y0 = (tile / tilesPerRow) * tileSize;
+                int columns = std::min(tileSize, width - x0);
+                int rows = std::min(tileSize, height - y0);
+                int count = rows * columns;
+
+                for(int p = 0; p < count; ++p)
+                    integrands[p] = pixelIntegrands(x0 + p % columns, y0 + p / columns, width, height);
+                std::fill(sums.begin(), sums.end(), 0.f);
+
+                for(int s = 0; s < spp; ++s) {
+                    sampler.sampleTile(y0, x0, rows, columns, frame, s, arguments.dimension, 2, samples.data());
+
+                    for(int p = 0; p < count; ++p) {
+                        const PixelIntegrands &pixel = integrands[p];
+                        float u = samples[2 * p];
+                        float v = samples[2 * p + 1];
+
+                        sums[p * IntegrandCount + Gaussian] += std::exp(-u * u - v * v);
+                        sums[p * IntegrandCount + Heaviside] +=
+                            (u - pixel.px) * pixel.nx + (v - pixel.py) * pixel.ny < 0.f ? 1.f : 0.f;
+
+                        bool hidden = u >= pixel.hiddenMin[0] && u < pixel.hiddenMax[0] && v >= pixel.hiddenMin[1] &&
+                                      v < pixel.hiddenMax[1];
+                        sums[p * IntegrandCount + Occlusion] += hidden ? 0.f : 1.f;
+                    }
+                }
+
+                for(int p = 0; p < count; ++p) {
+                    size_t pixel = size_t(y0 + p / columns) * width + x0 + p % columns;
+
+                    for(int k = 0; k < IntegrandCount; ++k)
+                        estimates[k * pixelCount + pixel] = sums[p * IntegrandCount + k] / spp;
+                }
+            }
+        }
+
+        renderSeconds += duration<double>(steady_clock::now() - start).count();
+
+        // Error of the frame: its mean squared value, and its spectrum over the blocks covered by the mask
+        std::vector<double> block(size_t(blockSize) * blockSize);
+        for(int k = 0; k < IntegrandCount; ++k) {
+            const float *estimate = &estimates[k * pixelCount];
+            const float *exact = &references[k * pixelCount];
+
+            for(size_t p = 0; p < pixelCount; ++p)
+                squaredErrors[k] += double(estimate[p] - exact[p]) * (estimate[p] - exact[p]);
+
+            for(int b = 0; b < blockCount; ++b) {
+                int x0 = (b % (width / blockSize)) * blockSize;
+                int y0 = (b / (width / blockSize)) * blockSize;
+
+                for(int y = 0; y < blockSize; ++y)
+                    for(int x = 0; x < blockSize; ++x) {
+                        size_t p = size_t(y0 + y) * width + x0 + x;
+                        block[size_t(y) * blockSize + x] = estimate[p] - exact[p];
+                    }
+
+                accumulatePowerSpectrum(block, blockSize, spectra[k]);
+            }
+        }
+    }
+
+    const double sampleCount = double(pixelCount) * spp * arguments.frames;
+    LOG << "Sampling: " << sampleCount / samplingSeconds / threads / 1e6 << " M samples/s per core ("
+        << samplingSeconds << "s)" << std::endl;
+    LOG << "Rendering: " << sampleCount / renderSeconds / threads / 1e6 << " M samples/s per core (" << renderSeconds
+        << "s)" << std::endl;
+
+    for(int k = 0; k < IntegrandCount; ++k) {
+        double rmse = std::sqrt(squaredErrors[k] / (double(pixelCount) * arguments.frames));
+
+        LOG << IntegrandNames[k] << ": RMSE " << rmse;
+        if(blockCount > 0)
+            std::cout << ", low frequency energy " << 100.0 * lowFrequencyEnergy(spectra[k], blockSize, arguments.cutoff)
+                      << "% (white noise: " << 100.0 * lowFrequencyShare(blockSize, arguments.cutoff) << "%)";
+        std::cout << std::endl;
+
+        if(!arguments.spectrumPrefix.empty() && blockCount > 0) {
+            RadialSpectrum spectrum = radialAverage(spectra[k], blockSize);
+
+            std::string filename = arguments.spectrumPrefix + IntegrandNames[k] + ".csv";
+            std::ofstream file(filename);
+            file << "frequency,power,anisotropy\n";
+            for(int r = 0; r < (int)spectrum.power.size(); ++r)
+                file << double(r) / blockSize << "," << spectrum.power[r] / (double(blockCount) * arguments.frames)
+                     << "," << spectrum.anisotropy[r] << "\n";
+
+            if(!file)
+                WARN << "Could not write the spectrum in " << filename << std::endl;
+        }
+    }
+
+    // Keeps the sampling pass from being optimized away
+    if(checksum < 0.0)
+        LOG << checksum << std::endl;
+
+    return SUCCESS;
+}
+
+bool handleArgs(int argc, char **argv, Arguments &arguments) {
+    if(argc < 2 || std::strncmp(argv[1], "--", 2) == 0)
+        return false;
+
+    arguments.maskFile = argv[1];
+
+    for(int i = 2; i < argc; ++i) {
+        std::string option(argv[i]);
+
+        if(i + 1 == argc)
+            return false;
+
+        std::string value(argv[++i]);
+
+        if(option == "--resolution") {
+            if(i + 1 == argc)
+                return false;
+
+            arguments.width = std::atoi(value.c_str());
+            arguments.height = std::atoi(argv[++i]);
+        } else if(option == "--tile") {
+            arguments.tileSize = std::atoi(value.c_str());
+        } else if(option == "--spp") {
+            arguments.spp = std::atoi(value.c_str());
+        } else if(option == "--frames") {
+            arguments.frames = std::atoi(value.c_str());
+        } else if(option == "--threads") {
+            arguments.threads = std::atoi(value.c_str());
+        } else if(option == "--dimension") {
+            arguments.dimension = std::atoi(value.c_str());
+        } else if(option == "--cutoff") {
+            arguments.cutoff = std::atof(value.c_str());
+        } else if(option == "--spectrum") {
+            arguments.spectrumPrefix = value;
+        } else
+            return false;
+    }
+
+    return arguments.width > 0 && arguments.height > 0 && arguments.tileSize > 0 && arguments.spp >= 0 &&
+           arguments.frames > 0 && arguments.threads >= 0 && arguments.dimension >= 0 &&
+           arguments.dimension % 2 == 0 && arguments.cutoff > 0.0 && arguments.cutoff <= 1.0;
+}
@@ -0,0 +1,87 @@
+#include <exporter.hpp>
+
+#include <chrono>
+
+
+// Rebuild a mask from the swap log exported along with it, e.g. when installing the masks instead of shipping them
+
+using std::chrono::duration;
+using std::chrono::steady_clock;
+
+struct Arguments {
+    std::string logFile;
+
+    std::string maskFile; // Empty to name the header after the log
+};
+
+bool handleArgs(int argc, char **argv, Arguments &arguments);
+
+
+int main(int argc, char **argv) {
+    Arguments arguments;
+    if(!handleArgs(argc, argv, arguments)) {
+        ERROR << "Invalid arguments, usage :\n"
+                 "./Replayer SwapLog [Options]\n"
+                 "Options:\n"
+                 "    --output MaskHeader               Header to export the mask in, the textures of the mask being "
+                 "named after it (default: the log with the .h extension)"
+              << std::endl;
+
+        return INVALID_ARGUMENTS;
+    }
+
+    if(arguments.maskFile.empty()) {
+        arguments.maskFile = arguments.logFile;
+
+        size_t extension = arguments.maskFile.find_last_of('.');
+        if(extension != std::string::npos && arguments.maskFile.find_first_of("/\\", extension) == std::string::npos)
+            arguments.maskFile.resize(extension);
+        arguments.maskFile += ".h";
+    }
+
+    steady_clock::time_point start = steady_clock::now();
+
+    OptimizerSettings settings;
+    std::vector<GLuint> scrambles;
+    std::vector<GLuint> rankings;
+    if(!loadSwapLog(arguments.logFile.c_str(), settings, scrambles, rankings)) {
+        ERROR << "Could not read the swap log " << arguments.logFile << std::endl;
+
+        return MASK_LOAD_ERROR;
+    }
+
+    LOG << "Replayed a " << settings.maskSize << "x" << settings.maskSize << " mask of " << settings.frames
+        << " frame(s), " << settings.dimensions << " optimized dimensions and " << settings.spp << " spp in "
+        << duration<double>(steady_clock::now() - start).count() * 1000.0 << "ms" << std::endl;
+
+    start = steady_clock::now();
+    exportMask(arguments.maskFile.c_str(), settings, scrambles, rankings);
+
+    LOG << "Exported the mask in " << arguments.maskFile << " in "
+        << duration<double>(steady_clock::now() - start).count() * 1000.0 << "ms" << std::endl;
+
+    return SUCCESS;
+}
+
+bool handleArgs(int argc, char **argv, Arguments &arguments) {
+    if(argc < 2)
+        return false;
+
+    arguments.logFile = argv[1];
+
+    for(int i = 2; i < argc; ++i) {
+        std::string option(argv[i]);
+
+        if(i + 1 == argc)
+            return false;
+
+        std::string value(argv[++i]);
+
+        if(option == "--output")
+            arguments.maskFile = value;
+        else
+            return false;
+    }
+
+    return true;
+}